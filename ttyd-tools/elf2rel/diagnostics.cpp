@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+
+// Serialized diagnostics are one per line with unit separated fields.
+// Section and suggestion lists are record separated within their field.
+const char cFieldSeparator = '\x1f';
+const char cListSeparator = '\x1e';
+
+const char *getSeverityName(DiagnosticSeverity severity)
+{
+	switch (severity)
+	{
+	case DiagnosticSeverity::Note: return "note";
+	case DiagnosticSeverity::Warning: return "warning";
+	case DiagnosticSeverity::Error: return "error";
+	default: return "unknown";
+	}
+}
+
+std::vector<std::string> splitString(const std::string &value, char separator)
+{
+	std::vector<std::string> parts;
+	size_t start = 0;
+	for (;;)
+	{
+		size_t end = value.find(separator, start);
+		parts.emplace_back(value.substr(start, end - start));
+		if (end == std::string::npos)
+		{
+			break;
+		}
+		start = end + 1;
+	}
+	return parts;
+}
+
+std::string joinStrings(const std::vector<std::string> &values, const char *separator)
+{
+	std::string result;
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		if (i)
+		{
+			result += separator;
+		}
+		result += values[i];
+	}
+	return result;
+}
+
+void addUnique(std::vector<std::string> &values, const std::string &value)
+{
+	if (std::find(values.begin(), values.end(), value) == values.end())
+	{
+		values.emplace_back(value);
+	}
+}
+
+}
+
+void Diagnostics::report(DiagnosticSeverity severity,
+						 const char *code,
+						 const std::string &subject,
+						 const std::string &section,
+						 const char *format,
+						 ...)
+{
+	va_list args;
+	va_start(args, format);
+	va_list sizeArgs;
+	va_copy(sizeArgs, args);
+	int length = vsnprintf(nullptr, 0, format, sizeArgs);
+	va_end(sizeArgs);
+
+	std::string message;
+	if (length > 0)
+	{
+		message.resize(length + 1);
+		vsnprintf(&message[0], length + 1, format, args);
+		message.resize(length);
+	}
+	va_end(args);
+
+	Diagnostic &diagnostic = add(severity, code, subject, message);
+	++diagnostic.count;
+	if (!section.empty())
+	{
+		addUnique(diagnostic.sections, section);
+	}
+}
+
+void Diagnostics::merge(const Diagnostics &other)
+{
+	for (const auto &otherDiagnostic : other.mDiagnostics)
+	{
+		Diagnostic &diagnostic = add(otherDiagnostic.severity,
+									 otherDiagnostic.code,
+									 otherDiagnostic.subject,
+									 otherDiagnostic.message);
+		diagnostic.count += otherDiagnostic.count;
+		for (const auto &section : otherDiagnostic.sections)
+		{
+			addUnique(diagnostic.sections, section);
+		}
+		for (const auto &suggestion : otherDiagnostic.suggestions)
+		{
+			addUnique(diagnostic.suggestions, suggestion);
+		}
+	}
+}
+
+void Diagnostics::setSeverity(const char *code, DiagnosticSeverity severity)
+{
+	for (auto &diagnostic : mDiagnostics)
+	{
+		if (diagnostic.code == code)
+		{
+			diagnostic.severity = severity;
+		}
+	}
+}
+
+int Diagnostics::getCount(DiagnosticSeverity severity) const
+{
+	return static_cast<int>(std::count_if(mDiagnostics.begin(), mDiagnostics.end(), [&](const Diagnostic &diagnostic)
+	{
+		return diagnostic.severity == severity;
+	}));
+}
+
+std::string Diagnostics::formatText() const
+{
+	std::string text;
+	for (const auto &diagnostic : mDiagnostics)
+	{
+		text += getSeverityName(diagnostic.severity);
+		text += ": ";
+		text += diagnostic.message;
+		text += "\n";
+		if (!diagnostic.sections.empty())
+		{
+			char countText[32];
+			snprintf(countText, sizeof(countText), "%u", diagnostic.count);
+			text += "  referenced ";
+			text += countText;
+			text += diagnostic.count == 1 ? " time from " : " times from ";
+			text += joinStrings(diagnostic.sections, ", ");
+			text += "\n";
+		}
+		if (!diagnostic.suggestions.empty())
+		{
+			text += "  did you mean '";
+			text += joinStrings(diagnostic.suggestions, "', '");
+			text += "'?\n";
+		}
+	}
+	return text;
+}
+
+std::string Diagnostics::formatJson() const
+{
+	auto formatList = [](const std::vector<std::string> &values)
+	{
+		std::string list = "[";
+		for (size_t i = 0; i < values.size(); ++i)
+		{
+			list += i ? ", " : "";
+			list += escapeJsonString(values[i]);
+		}
+		return list + "]";
+	};
+
+	std::string json = "[";
+	for (size_t i = 0; i < mDiagnostics.size(); ++i)
+	{
+		const Diagnostic &diagnostic = mDiagnostics[i];
+		char countText[32];
+		snprintf(countText, sizeof(countText), "%u", diagnostic.count);
+
+		json += i ? ",\n" : "\n";
+		json += "\t{\"severity\": \"";
+		json += getSeverityName(diagnostic.severity);
+		json += "\", \"code\": " + escapeJsonString(diagnostic.code);
+		json += ", \"subject\": " + escapeJsonString(diagnostic.subject);
+		json += ", \"message\": " + escapeJsonString(diagnostic.message);
+		json += ", \"count\": ";
+		json += countText;
+		json += ", \"sections\": " + formatList(diagnostic.sections);
+		json += ", \"suggestions\": " + formatList(diagnostic.suggestions);
+		json += "}";
+	}
+	json += mDiagnostics.empty() ? "]" : "\n]";
+	return json;
+}
+
+std::string Diagnostics::serialize() const
+{
+	std::string data;
+	for (const auto &diagnostic : mDiagnostics)
+	{
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "%d%c%u%c",
+				 static_cast<int>(diagnostic.severity),
+				 cFieldSeparator,
+				 diagnostic.count,
+				 cFieldSeparator);
+		data += prefix;
+		data += diagnostic.code + cFieldSeparator;
+		data += diagnostic.subject + cFieldSeparator;
+		data += diagnostic.message + cFieldSeparator;
+		data += joinStrings(diagnostic.sections, std::string(1, cListSeparator).c_str()) + cFieldSeparator;
+		data += joinStrings(diagnostic.suggestions, std::string(1, cListSeparator).c_str()) + '\n';
+	}
+	return data;
+}
+
+bool Diagnostics::deserialize(const std::string &data)
+{
+	mDiagnostics.clear();
+	mIndex.clear();
+	for (const auto &line : splitString(data, '\n'))
+	{
+		if (line.empty())
+		{
+			continue;
+		}
+
+		std::vector<std::string> fields = splitString(line, cFieldSeparator);
+		if (fields.size() != 7)
+		{
+			return false;
+		}
+		int severity = atoi(fields[0].c_str());
+		if (severity < static_cast<int>(DiagnosticSeverity::Note) || severity > static_cast<int>(DiagnosticSeverity::Error))
+		{
+			return false;
+		}
+
+		Diagnostic &diagnostic = add(static_cast<DiagnosticSeverity>(severity), fields[2], fields[3], fields[4]);
+		diagnostic.count += static_cast<uint32_t>(strtoul(fields[1].c_str(), nullptr, 10));
+		if (!fields[5].empty())
+		{
+			diagnostic.sections = splitString(fields[5], cListSeparator);
+		}
+		if (!fields[6].empty())
+		{
+			diagnostic.suggestions = splitString(fields[6], cListSeparator);
+		}
+	}
+	return true;
+}
+
+Diagnostics::Diagnostic &Diagnostics::add(DiagnosticSeverity severity,
+										  const std::string &code,
+										  const std::string &subject,
+										  const std::string &message)
+{
+	auto it = mIndex.find(std::make_pair(code, message));
+	if (it != mIndex.end())
+	{
+		Diagnostic &diagnostic = mDiagnostics[it->second];
+		diagnostic.severity = std::max(diagnostic.severity, severity);
+		return diagnostic;
+	}
+
+	mIndex.emplace(std::make_pair(code, message), mDiagnostics.size());
+	Diagnostic diagnostic;
+	diagnostic.severity = severity;
+	diagnostic.code = code;
+	diagnostic.subject = subject;
+	diagnostic.message = message;
+	diagnostic.count = 0;
+	mDiagnostics.emplace_back(std::move(diagnostic));
+	return mDiagnostics.back();
+}
+
+std::string escapeJsonString(const std::string &value)
+{
+	std::string escaped = "\"";
+	for (char c : value)
+	{
+		switch (c)
+		{
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+				escaped += code;
+			}
+			else
+			{
+				escaped += c;
+			}
+			break;
+		}
+	}
+	return escaped + "\"";
+}
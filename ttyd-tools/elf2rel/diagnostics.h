@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class DiagnosticSeverity
+{
+	Note,
+	Warning,
+	Error,
+};
+
+// Warnings and errors of a single conversion. Reports with the same code and
+// message are merged into one diagnostic that counts how often it came up and
+// remembers every section it came from.
+class Diagnostics
+{
+public:
+	struct Diagnostic
+	{
+		DiagnosticSeverity severity;
+		std::string code; // Stable identifier for tools, e.g. "unresolved-symbol"
+		std::string subject; // Symbol the diagnostic is about, if any
+		std::string message;
+		std::vector<std::string> sections;
+		std::vector<std::string> suggestions;
+		uint32_t count;
+	};
+
+	void report(DiagnosticSeverity severity,
+				const char *code,
+				const std::string &subject,
+				const std::string &section,
+				const char *format,
+				...);
+	void merge(const Diagnostics &other);
+
+	// Changes the severity of everything reported under a code
+	void setSeverity(const char *code, DiagnosticSeverity severity);
+
+	int getCount(DiagnosticSeverity severity) const;
+
+	std::vector<Diagnostic> &getDiagnostics()
+	{
+		return mDiagnostics;
+	}
+	const std::vector<Diagnostic> &getDiagnostics() const
+	{
+		return mDiagnostics;
+	}
+
+	// One block per diagnostic, in the order they were first reported
+	std::string formatText() const;
+	// JSON array of all diagnostics
+	std::string formatJson() const;
+
+	// Compact form for the relocation cache
+	std::string serialize() const;
+	bool deserialize(const std::string &data);
+
+private:
+	Diagnostic &add(DiagnosticSeverity severity,
+					const std::string &code,
+					const std::string &subject,
+					const std::string &message);
+
+private:
+	std::vector<Diagnostic> mDiagnostics;
+	// (code, message) to index into mDiagnostics
+	std::map<std::pair<std::string, std::string>, size_t> mIndex;
+};
+
+// Quotes and escapes a string for JSON output
+std::string escapeJsonString(const std::string &value);
@@ -2,113 +2,174 @@
 // Copyright 2019 Linus S. (aka PistonMiner)
 
 #include "elf2rel.h"
+#include "symbolmap.h"
+#include "relcache.h"
+#include "diagnostics.h"
+#include "relmap.h"
 
 #include <elfio/elfio.hpp>
 
 #include <boost/program_options.hpp>
-#include <boost/algorithm/string.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include <iostream>
 #include <fstream>
-#include <tuple>
-#include <deque>
+#include <sstream>
+#include <unordered_map>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <queue>
+#include <functional>
+#include <numeric>
+#include <chrono>
+#include <cstring>
 
-std::map<std::string, uint32_t> loadSymbolMap(const std::string &filename)
+struct Symbol
 {
-	std::map<std::string, uint32_t> outputMap;
+	const char *name; // Points into the string table of the input
+	uint32_t value;
+	uint32_t size;
+	uint16_t sectionIndex;
+	uint8_t bind;
+	uint8_t type;
+};
+
+struct CStringHash
+{
+	size_t operator()(const char *str) const
+	{
+		return hashString(str, str + strlen(str));
+	}
+};
+
+struct CStringEqual
+{
+	bool operator()(const char *left, const char *right) const
+	{
+		return strcmp(left, right) == 0;
+	}
+};
 
-	std::ifstream inputStream(filename);
-	for (std::string line; std::getline(inputStream, line); )
+class SymbolTable
+{
+public:
+	SymbolTable(const ELFIO::elfio &elf, const ELFIO::section *symSection)
 	{
-		boost::trim_left(line);
+		const auto &convertor = elf.get_convertor();
+		const ELFIO::section *strSection = elf.sections[symSection->get_link()];
+		const char *strData = strSection->get_data();
+		size_t strSize = strData ? static_cast<size_t>(strSection->get_size()) : 0;
 
-		// Ignore comments
-		if (line.size() == 0 || line.find_first_of("//") == 0)
+		size_t count = static_cast<size_t>(symSection->get_size() / sizeof(ELFIO::Elf32_Sym));
+		const ELFIO::Elf32_Sym *rawSymbols = reinterpret_cast<const ELFIO::Elf32_Sym *>(symSection->get_data());
+
+		mSymbols.resize(count);
+		mNameIndex.reserve(count);
+		for (size_t i = 0; i < count; ++i)
 		{
-			continue;
-		}
+			const ELFIO::Elf32_Sym &raw = rawSymbols[i];
+			Symbol &symbol = mSymbols[i];
+
+			uint32_t nameOffset = convertor(raw.st_name);
+			symbol.name = nameOffset < strSize ? strData + nameOffset : "";
+			symbol.value = convertor(raw.st_value);
+			symbol.size = convertor(raw.st_size);
+			symbol.sectionIndex = convertor(raw.st_shndx);
+			symbol.bind = ELF_ST_BIND(raw.st_info);
+			symbol.type = ELF_ST_TYPE(raw.st_info);
 
-		size_t index = line.find_first_of(':');
+			// First definition wins if a name is present multiple times
+			if (symbol.name[0] != '\0')
+			{
+				mNameIndex.emplace(symbol.name, static_cast<uint32_t>(i));
+			}
+		}
+	}
 
-		std::string name = line.substr(index + 1);
-		boost::trim_left(name);
+	size_t size() const
+	{
+		return mSymbols.size();
+	}
 
-		uint32_t addr = strtoul(line.substr(0, index).c_str(), nullptr, 16);
+	const Symbol &operator[](size_t index) const
+	{
+		return mSymbols[index];
+	}
 
-		outputMap[name] = addr;
+	const Symbol *find(const char *name) const
+	{
+		auto it = mNameIndex.find(name);
+		if (it == mNameIndex.end())
+		{
+			return nullptr;
+		}
+		return &mSymbols[it->second];
 	}
 
-	return outputMap;
-}
+private:
+	std::vector<Symbol> mSymbols;
+	std::unordered_map<const char *, uint32_t, CStringHash, CStringEqual> mNameIndex;
+};
+
+// All writers fill in a preallocated buffer and return the end of what they wrote
+uint8_t *writeModuleHeader(uint8_t *buffer, const RelModuleHeader &header)
+{
+	writeBigEndian<uint32_t>(buffer + 0x00, header.id);
+	writeBigEndian<uint32_t>(buffer + 0x04, 0); // prev link
+	writeBigEndian<uint32_t>(buffer + 0x08, 0); // next link
+	writeBigEndian<uint32_t>(buffer + 0x0C, header.sectionCount);
+	writeBigEndian<uint32_t>(buffer + 0x10, header.sectionInfoOffset);
+	writeBigEndian<uint32_t>(buffer + 0x14, header.nameOffset);
+	writeBigEndian<uint32_t>(buffer + 0x18, header.nameSize);
+	writeBigEndian<uint32_t>(buffer + 0x1C, header.version);
 
-void writeModuleHeader(std::vector<uint8_t> &buffer,
-					   int version,
-					   int id,
-					   int sectionCount,
-					   int sectionInfoOffset,
-					   int totalBssSize,
-					   int relocationOffset,
-					   int importInfoOffset,
-					   int importInfoSize,
-					   int prologSection,
-					   int epilogSection,
-					   int unresolvedSection,
-					   int prologOffset,
-					   int epilogOffset,
-					   int unresolvedOffset,
-					   int maxAlign,
-					   int maxBssAlign,
-					   int fixedDataSize)
-{
-	save<uint32_t>(buffer, id);
-	save<uint32_t>(buffer, 0); // prev link
-	save<uint32_t>(buffer, 0); // next link
-	save<uint32_t>(buffer, sectionCount);
-	save<uint32_t>(buffer, sectionInfoOffset);
-	save<uint32_t>(buffer, 0); // name offset
-	save<uint32_t>(buffer, 0); // name size
-	save<uint32_t>(buffer, version); // version
-
-	save<uint32_t>(buffer, totalBssSize);
-	save<uint32_t>(buffer, relocationOffset);
-	save<uint32_t>(buffer, importInfoOffset);
-	save<uint32_t>(buffer, importInfoSize);
-	save<uint8_t>(buffer, prologSection);
-	save<uint8_t>(buffer, epilogSection);
-	save<uint8_t>(buffer, unresolvedSection);
-	save<uint8_t>(buffer, 0); // pad
-	save<uint32_t>(buffer, prologOffset);
-	save<uint32_t>(buffer, epilogOffset);
-	save<uint32_t>(buffer, unresolvedOffset);
-	if (version >= 2)
-	{
-		save<uint32_t>(buffer, maxAlign);
-		save<uint32_t>(buffer, maxBssAlign);
-	}
-	if (version >= 3)
-	{
-		save<uint32_t>(buffer, fixedDataSize);
+	writeBigEndian<uint32_t>(buffer + 0x20, header.totalBssSize);
+	writeBigEndian<uint32_t>(buffer + 0x24, header.relocationOffset);
+	writeBigEndian<uint32_t>(buffer + 0x28, header.importInfoOffset);
+	writeBigEndian<uint32_t>(buffer + 0x2C, header.importInfoSize);
+	writeBigEndian<uint8_t>(buffer + 0x30, header.prologSection);
+	writeBigEndian<uint8_t>(buffer + 0x31, header.epilogSection);
+	writeBigEndian<uint8_t>(buffer + 0x32, header.unresolvedSection);
+	writeBigEndian<uint8_t>(buffer + 0x33, 0); // pad
+	writeBigEndian<uint32_t>(buffer + 0x34, header.prologOffset);
+	writeBigEndian<uint32_t>(buffer + 0x38, header.epilogOffset);
+	writeBigEndian<uint32_t>(buffer + 0x3C, header.unresolvedOffset);
+	if (header.version >= 2)
+	{
+		writeBigEndian<uint32_t>(buffer + 0x40, header.maxAlign);
+		writeBigEndian<uint32_t>(buffer + 0x44, header.maxBssAlign);
 	}
+	if (header.version >= 3)
+	{
+		writeBigEndian<uint32_t>(buffer + 0x48, header.fixedDataSize);
+	}
+	return buffer + getModuleHeaderSize(header.version);
 }
 
-void writeSectionInfo(std::vector<uint8_t> &buffer, int offset, int size)
+uint8_t *writeSectionInfo(uint8_t *buffer, int offset, int size)
 {
-	save<uint32_t>(buffer, offset);
-	save<uint32_t>(buffer, size);
+	writeBigEndian<uint32_t>(buffer, offset);
+	writeBigEndian<uint32_t>(buffer + 4, size);
+	return buffer + 8;
 }
 
-void writeImportInfo(std::vector<uint8_t> &buffer, int id, int offset)
+uint8_t *writeImportInfo(uint8_t *buffer, int id, int offset)
 {
-	save<uint32_t>(buffer, id);
-	save<uint32_t>(buffer, offset);
+	writeBigEndian<uint32_t>(buffer, id);
+	writeBigEndian<uint32_t>(buffer + 4, offset);
+	return buffer + 8;
 }
 
-void writeRelocation(std::vector<uint8_t> &buffer, int offset, int type, int section, uint32_t addend)
+uint8_t *writeRelocation(uint8_t *buffer, int offset, int type, int section, uint32_t addend)
 {
-	save<uint16_t>(buffer, offset);
-	save<uint8_t>(buffer, type);
-	save<uint8_t>(buffer, section);
-	save<uint32_t>(buffer, addend);
+	writeBigEndian<uint16_t>(buffer, offset);
+	writeBigEndian<uint8_t>(buffer + 2, type);
+	writeBigEndian<uint8_t>(buffer + 3, section);
+	writeBigEndian<uint32_t>(buffer + 4, addend);
+	return buffer + 8;
 }
 
 const std::vector<std::string> cRelSectionMask = {
@@ -121,368 +182,184 @@ const std::vector<std::string> cRelSectionMask = {
 	".bss"
 };
 
-int main(int argc, char **argv)
+// Returns the entry of cRelSectionMask a section belongs to, if any
+const std::string *findRelSectionKind(const std::string &name)
 {
-	std::string elfFilename;
-	std::string lstFilename;
-	std::string relFilename = "";
-	int moduleID = 33;
-	int relVersion = 3;
-
+	for (const auto &kind : cRelSectionMask)
 	{
-		namespace po = boost::program_options;
-
-		po::options_description description("Options");
-		description.add_options()
-			("help", "Print help message")
-			("input-file,i", po::value(&elfFilename), "Input ELF filename (required)")
-			("symbol-file,s", po::value(&lstFilename), "Input symbol file name (required)")
-			("output-file,o", po::value(&relFilename), "Output REL filename")
-			("rel-id", po::value(&moduleID)->default_value(0x1000), "REL file ID")
-			("rel-version", po::value(&relVersion)->default_value(3), "REL file format version (1, 2, 3)");
-
-		po::positional_options_description positionals;
-		positionals.add("input-file", -1);
-
-		po::variables_map varMap;
-		po::store(
-			po::command_line_parser(argc, argv)
-				.options(description)
-				.positional(positionals)
-				.run(),
-			varMap
-		);
-		po::notify(varMap);
-
-		if (varMap.count("help")
-			|| varMap.count("input-file") != 1
-			|| varMap.count("symbol-file") != 1
-			|| relVersion < 1
-			|| relVersion > 3)
+		if (name == kind || name.compare(0, kind.size() + 1, kind + ".") == 0)
 		{
-			std::cout << description << "\n";
-			return 1;
+			return &kind;
 		}
 	}
+	return nullptr;
+}
 
-	if (relFilename == "")
-	{
-		relFilename = elfFilename.substr(0, elfFilename.find_last_of('.')) + ".rel";
-	}
-	
-	// Load input file
-	ELFIO::elfio inputElf;
-	if (!inputElf.load(elfFilename))
+template<typename DigitFunc>
+bool radixSortPass(const std::vector<Relocation> &input, std::vector<Relocation> &output, DigitFunc digit)
+{
+	size_t counts[256] = {};
+	for (const auto &rel : input)
 	{
-		printf("Failed to load input file\n");
-		return 1;
+		++counts[digit(rel)];
 	}
-	
-	auto externalSymbolMap = loadSymbolMap(lstFilename);
 
-	// Find special sections
-	ELFIO::section *symSection = nullptr;
-	std::vector<ELFIO::section *> relocationSections;
-	for (const auto &section : inputElf.sections)
+	// Nothing to do if every element has the same digit
+	for (size_t count : counts)
 	{
-		if (section->get_type() == SHT_SYMTAB)
-		{
-			symSection = section;
-		}
-		else if (section->get_type() == SHT_RELA)
+		if (count == input.size())
 		{
-			relocationSections.emplace_back(section);
+			return false;
 		}
 	}
 
-	// Symbol accessor
-	ELFIO::symbol_section_accessor symbols(inputElf, symSection);
+	size_t position = 0;
+	for (size_t &count : counts)
+	{
+		size_t start = position;
+		position += count;
+		count = start;
+	}
+	for (const auto &rel : input)
+	{
+		output[counts[digit(rel)]++] = rel;
+	}
+	return true;
+}
 
-	// Find prolog, epilog and unresolved
-	auto findSymbolSectionAndOffset = [&](const std::string &name, int &sectionIndex, int &offset)
+// Stable LSD radix sort by (module, section, offset)
+void sortRelocations(std::vector<Relocation> &relocations)
+{
+	std::vector<Relocation> scratch(relocations.size());
+	auto runPass = [&](auto digit)
 	{
-		ELFIO::Elf64_Addr addr;
-		ELFIO::Elf_Xword size;
-		unsigned char bind;
-		unsigned char type;
-		ELFIO::Elf_Half section_index;
-		unsigned char other;
-		for (int i = 0; i < symbols.get_symbols_num(); ++i)
+		if (radixSortPass(relocations, scratch, digit))
 		{
-			std::string symbolName;
-			if (symbols.get_symbol(static_cast<ELFIO::Elf_Xword>(i), symbolName, addr, size, bind, type, section_index, other))
-			{
-				if (symbolName == name)
-				{
-					sectionIndex = static_cast<int>(section_index);
-					offset = static_cast<int>(addr);
-					break;
-				}
-			}
+			relocations.swap(scratch);
 		}
 	};
 
-	int prologSectionIndex = 0, prologOffset = 0;
-	findSymbolSectionAndOffset("_prolog", prologSectionIndex, prologOffset);
-	int epilogSectionIndex = 0, epilogOffset = 0;
-	findSymbolSectionAndOffset("_epilog", epilogSectionIndex, epilogOffset);
-	int unresolvedSectionIndex = 0, unresolvedOffset = 0;
-	findSymbolSectionAndOffset("_unresolved", unresolvedSectionIndex, unresolvedOffset);
-
-	std::vector<uint8_t> outputBuffer;
-	// Dummy values for header until offsets are determined
-	writeModuleHeader(outputBuffer, relVersion, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
-	int sectionInfoOffset = outputBuffer.size();
-	for (int i = 0; i < inputElf.sections.size(); ++i)
+	for (int shift = 0; shift < 32; shift += 8)
 	{
-		writeSectionInfo(outputBuffer, 0, 0);
+		runPass([shift](const Relocation &rel) { return (rel.offset >> shift) & 0xFF; });
 	}
+	runPass([](const Relocation &rel) { return rel.section & 0xFF; });
+	runPass([](const Relocation &rel) { return rel.section >> 8; });
+	runPass([](const Relocation &rel) { return rel.moduleSlot; });
+}
 
-	// Write sections
-	std::vector<uint8_t> sectionInfoBuffer;
-	std::map<ELFIO::section *, int> writtenSections;
-	int totalBssSize = 0;
-	int maxAlign = 2;
-	int maxBssAlign = 2;
-	for (const auto &section : inputElf.sections)
+// Merges individually sorted runs into one sorted list. Ties go to the
+// earlier run, so the result matches stable sorting the concatenated runs.
+std::vector<Relocation> mergeRelocationRuns(const std::vector<std::vector<Relocation>> &runs)
+{
+	auto sortKey = [](const Relocation &rel)
 	{
-		// Should keep?
-		if (std::find_if(cRelSectionMask.begin(),
-						  cRelSectionMask.end(),
-						  [&](const std::string &val)
-		{
-			return val == section->get_name()
-				   || section->get_name().find(val + ".") == 0;
-		}) != cRelSectionMask.end())
-		{
-			// BSS?
-			if (section->get_type() == SHT_NOBITS)
-			{
-				// Update max alignment
-				int align = static_cast<int>(section->get_addr_align());
-				maxBssAlign = std::max(maxBssAlign, align);
-
-				int size = static_cast<int>(section->get_size());
-				totalBssSize += size;
-				writeSectionInfo(sectionInfoBuffer, 0, size);
-			}
-			else
-			{
-				// Update max alignment (minimum 2, low offset bit is used for exec flag)
-				int align = std::max(static_cast<int>(section->get_addr_align()), 2);
-				maxAlign = std::max(maxAlign, align);
-
-				// Write padding
-				int requiredPadding = ((outputBuffer.size() + align - 1) & ~(align - 1)) - outputBuffer.size();
-				for (int i = 0; i < requiredPadding; ++i)
-				{
-					save<uint8_t>(outputBuffer, 0);
-				}
-
-				int offset = outputBuffer.size();
-
-				int encodedOffset = offset;
-				// Mark executable sections
-				if (section->get_flags() & SHF_EXECINSTR)
-				{
-					encodedOffset |= 1;
-				}
-				writeSectionInfo(sectionInfoBuffer, encodedOffset, static_cast<int>(section->get_size()));
-				std::vector<uint8_t> sectionData(section->get_data(), section->get_data() + section->get_size());
-				outputBuffer.insert(outputBuffer.end(), sectionData.begin(), sectionData.end());
+		return static_cast<uint64_t>(rel.moduleSlot) << 48
+			   | static_cast<uint64_t>(rel.section) << 32
+			   | rel.offset;
+	};
 
-				writtenSections[section] = offset;
-			}
-		}
-		else
+	// Heap of (key, run index) for the next relocation of every run
+	using HeapEntry = std::pair<uint64_t, size_t>;
+	std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+	std::vector<size_t> positions(runs.size(), 0);
+	size_t totalCount = 0;
+	for (size_t i = 0; i < runs.size(); ++i)
+	{
+		totalCount += runs[i].size();
+		if (!runs[i].empty())
 		{
-			// Section was removed
-			writeSectionInfo(sectionInfoBuffer, 0, 0);
+			heap.emplace(sortKey(runs[i][0]), i);
 		}
 	}
-	// Fill in section info in main buffer
-	std::copy(sectionInfoBuffer.begin(), sectionInfoBuffer.end(), outputBuffer.begin() + sectionInfoOffset);
 
-	// Find all relocations
-	struct Relocation
-	{
-		uint32_t moduleID; // target module
-		uint32_t section;
-		uint32_t offset;
-		uint8_t targetSection;  // target symbol
-		uint32_t addend;
-		uint8_t type;
-	};
-	std::deque<Relocation> allRelocations;
-	for (const auto &section : relocationSections)
+	std::vector<Relocation> merged;
+	merged.reserve(totalCount);
+	while (!heap.empty())
 	{
-		int relocatedSectionIndex = section->get_info();
-		ELFIO::section *relocatedSection = inputElf.sections[relocatedSectionIndex];
-		// Only relocate sections that were written
-		if (writtenSections.find(relocatedSection) != writtenSections.end())
-		{
-			ELFIO::relocation_section_accessor relocations(inputElf, section);
-			// #todo-elf2rel: Process relocations
-			for (int i = 0; i < relocations.get_entries_num(); ++i)
-			{
-				ELFIO::Elf64_Addr offset;
-				ELFIO::Elf_Word symbol;
-				ELFIO::Elf_Word type;
-				ELFIO::Elf_Sxword addend;
-				relocations.get_entry(i, offset, symbol, type, addend);
-
-				// Ignore R_PPC_NONE
-				if (type == R_PPC_NONE)
-					continue;
-
-				ELFIO::Elf_Xword size;
-				unsigned char bind;
-				unsigned char symbolType;
-				ELFIO::Elf_Half sectionIndex;
-				unsigned char other;
-				std::string symbolName;
-				ELFIO::Elf64_Addr symbolValue;
-				if (!symbols.get_symbol(symbol, symbolName, symbolValue,
-										size, bind, symbolType, sectionIndex, other))
-				{
-					printf("Unable to find symbol %u in symbol table!\n", static_cast<uint32_t>(symbol));
-					return 1;
-				}
-
-				// Add relocation to list
-				bool resolved = false;
-				Relocation rel;
-				rel.section = relocatedSectionIndex;
-				rel.offset = static_cast<uint32_t>(offset);
-				rel.type = type;
-				if (sectionIndex)
-				{
-					// Self-relocation
-					resolved = true;
-
-					rel.moduleID = moduleID;
-					rel.targetSection = static_cast<uint8_t>(sectionIndex);
-					rel.addend = static_cast<uint32_t>(addend + symbolValue);
-
-					ELFIO::section *targetSection = inputElf.sections[rel.targetSection];
-					if (writtenSections.find(targetSection) == writtenSections.end() && targetSection->get_type() != SHT_NOBITS)
-					{
-						printf("Relocation from section '%s' offset %llx against symbol '%s' in unwritten section '%s'\n",
-							   relocatedSection->get_name().c_str(),
-							   offset,
-							   symbolName.c_str(),
-							   targetSection->get_name().c_str());
-					}
-				}
-				else
-				{
-					// Symbol is unknown, check if it's an external known symbol
-					auto it = externalSymbolMap.find(symbolName);
-					if (it != externalSymbolMap.end())
-					{
-						// Known external!
-						resolved = true;
-
-						rel.moduleID = 0;
-						rel.targetSection = 0; // #todo-elf2rel: Check if this is important
-						rel.addend = static_cast<uint32_t>(addend + it->second);
-					}
-				}
+		size_t runIndex = heap.top().second;
+		heap.pop();
 
-				if (resolved)
-				{
-					allRelocations.emplace_back(rel);
-				}
-				else
-				{
-					printf("Unresolved external symbol '%s'\n", symbolName.c_str());
-				}
-			}
+		const std::vector<Relocation> &run = runs[runIndex];
+		size_t &position = positions[runIndex];
+		merged.emplace_back(run[position++]);
+		if (position < run.size())
+		{
+			heap.emplace(sortKey(run[position]), runIndex);
 		}
 	}
+	return merged;
+}
 
-	// Sort relocations
-	std::sort(allRelocations.begin(), allRelocations.end(),
-			  [](const Relocation &left, const Relocation &right)
-	{
-		return std::tuple<uint32_t, uint32_t, uint32_t>(left.moduleID, left.section, left.offset)
-			   < std::tuple<uint32_t, uint32_t, uint32_t>(right.moduleID, right.section, right.offset);
-	});
+int getDefaultThreadCount()
+{
+	return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
 
-	// Count modules
-	int importCount = 0;
-	int lastModuleID = -1;
-	for (const auto &rel : allRelocations)
+// Number of threads parallelFor runs count items on, at least one
+size_t getWorkerCount(size_t count, int threadCount)
+{
+	return std::max<size_t>(std::min(static_cast<size_t>(std::max(threadCount, 1)), count), 1);
+}
+
+// Calls func(index) for every index in [0, count) on up to threadCount threads
+template<typename Func>
+void parallelFor(size_t count, int threadCount, Func func)
+{
+	size_t workerCount = getWorkerCount(count, threadCount);
+	if (workerCount <= 1)
 	{
-		if (lastModuleID != rel.moduleID)
+		for (size_t i = 0; i < count; ++i)
 		{
-			lastModuleID = rel.moduleID;
-			++importCount;
+			func(i);
 		}
+		return;
 	}
 
-	// Write padding for imports
-	int requiredPadding = 8 - outputBuffer.size() % 8;
-	for (int i = 0; i < requiredPadding; ++i)
+	std::atomic<size_t> nextIndex(0);
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < workerCount; ++i)
 	{
-		save<uint8_t>(outputBuffer, 0);
+		workers.emplace_back([&]()
+		{
+			for (size_t index = nextIndex++; index < count; index = nextIndex++)
+			{
+				func(index);
+			}
+		});
 	}
-
-	// Write dummy imports
-	int importInfoOffset = outputBuffer.size();
-	for (int i = 0; i < importCount; ++i)
+	for (auto &worker : workers)
 	{
-		writeImportInfo(outputBuffer, 0, 0);
+		worker.join();
 	}
+}
 
-	// Write out relocations
-	int relocationOffset = outputBuffer.size();
-
-	std::vector<uint8_t> importInfoBuffer;
-	int currentModuleID = -1;
+// Walks sorted relocations in REL stream order. onImport(moduleID) is called
+// whenever a module's relocation list starts and onEntry(offset, type,
+// section, addend) for every 8 byte entry of the stream.
+template<typename ImportFunc, typename EntryFunc>
+void generateRelocationStream(const std::vector<Relocation> &relocations,
+							  const std::vector<uint32_t> &importModules,
+							  ImportFunc onImport,
+							  EntryFunc onEntry)
+{
+	int currentModuleSlot = -1;
 	int currentSectionIndex = -1;
 	int currentOffset = 0;
-	while (!allRelocations.empty())
+	for (const Relocation &nextRel : relocations)
 	{
-		Relocation nextRel = allRelocations.front();
-		allRelocations.pop_front();
-		
-		// Resolve early if possible
-		if (nextRel.moduleID == moduleID && (nextRel.type == R_PPC_REL24 || nextRel.type == R_PPC_REL32))
-		{
-			int offset = writtenSections.at(inputElf.sections[nextRel.section]) + nextRel.offset;
-			int delta = writtenSections.at(inputElf.sections[nextRel.targetSection]) + nextRel.addend - offset;
-			std::vector<uint8_t> instructionBuffer(outputBuffer.begin() + offset, outputBuffer.begin() + offset + 4);
-			uint32_t patchedData;
-			load(instructionBuffer, patchedData);
-			
-			if (nextRel.type == R_PPC_REL24)
-			{
-				patchedData |= (delta & 0x03FFFFFC);
-			}
-			else if (nextRel.type == R_PPC_REL32)
-			{
-				patchedData = delta;
-			}
-			
-			save(instructionBuffer, patchedData);
-			std::copy(instructionBuffer.begin(), instructionBuffer.end(), outputBuffer.begin() + offset);
-
-			continue;
-		}
-
 		// Change module if necessary
-		if (currentModuleID != nextRel.moduleID)
+		if (currentModuleSlot != nextRel.moduleSlot)
 		{
 			// Not first module?
-			if (currentModuleID != -1)
+			if (currentModuleSlot != -1)
 			{
-				writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
+				onEntry(0, R_DOLPHIN_END, 0, 0);
 			}
 
-			currentModuleID = nextRel.moduleID;
+			currentModuleSlot = nextRel.moduleSlot;
 			currentSectionIndex = -1;
-			writeImportInfo(importInfoBuffer, currentModuleID, outputBuffer.size());
+			onImport(importModules[currentModuleSlot]);
 		}
 
 		// Change section if necessary
@@ -490,71 +367,2110 @@ int main(int argc, char **argv)
 		{
 			currentSectionIndex = nextRel.section;
 			currentOffset = 0;
-			writeRelocation(outputBuffer, 0, R_DOLPHIN_SECTION, currentSectionIndex, 0);
+			onEntry(0, R_DOLPHIN_SECTION, currentSectionIndex, 0);
 		}
 
 		// Get into range of the target
 		int targetDelta = nextRel.offset - currentOffset;
 		while (targetDelta > 0xFFFF)
 		{
-			writeRelocation(outputBuffer, 0xFFFF, R_DOLPHIN_NOP, 0, 0);
+			onEntry(0xFFFF, R_DOLPHIN_NOP, 0, 0);
 			targetDelta -= 0xFFFF;
 		}
-		
-		// #todo-elf2rel: Add runtime unresolved symbol handling here
-		// At this point, only symbols that OSLink can handle should remain
-		switch (nextRel.type)
-		{
-		case R_PPC_NONE:
-		case R_PPC_ADDR32:
-		case R_PPC_ADDR24:
-		case R_PPC_ADDR16:
-		case R_PPC_ADDR16_LO:
-		case R_PPC_ADDR16_HI:
-		case R_PPC_ADDR16_HA:
-		case R_PPC_ADDR14:
-		case R_PPC_ADDR14_BRTAKEN:
-		case R_PPC_ADDR14_BRNKTAKEN:
-		case R_PPC_REL24:
-		case R_DOLPHIN_NOP:
-		case R_DOLPHIN_SECTION:
-		case R_DOLPHIN_END:
-			break;
-		default:
-			printf("Unsupported relocation type %d\n", nextRel.type);
-			break;
-		}
 
-		writeRelocation(outputBuffer, targetDelta, nextRel.type, nextRel.targetSection, nextRel.addend);
+		onEntry(targetDelta, nextRel.type, nextRel.targetSection, nextRel.addend);
 		currentOffset = nextRel.offset;
 	}
-	writeRelocation(outputBuffer, 0, R_DOLPHIN_END, 0, 0);
+	onEntry(0, R_DOLPHIN_END, 0, 0);
+}
 
-	// Write final import infos
-	int importInfoSize = importInfoBuffer.size();
-	std::copy(importInfoBuffer.begin(), importInfoBuffer.end(), outputBuffer.begin() + importInfoOffset);
-		
-	// Write final header
-	std::vector<uint8_t> headerBuffer;
-	writeModuleHeader(headerBuffer,
-					  relVersion,
-					  moduleID,
-					  inputElf.sections.size(),
-					  sectionInfoOffset,
-					  totalBssSize,
-					  relocationOffset,
-					  importInfoOffset,
-					  importInfoSize,
-					  prologSectionIndex, epilogSectionIndex, unresolvedSectionIndex,
-					  prologOffset, epilogOffset, unresolvedOffset,
-					  maxAlign,
-					  maxBssAlign,
-					  relocationOffset);
-	std::copy(headerBuffer.begin(), headerBuffer.end(), outputBuffer.begin());
+// Patches a relocation with final addresses, the way OSLink would apply it.
+// Returns false for types that can't be resolved statically.
+bool applyRelocation(uint8_t *patchAddress, int type, uint32_t patchVirtualAddress, uint32_t targetVirtualAddress)
+{
+	uint32_t value = targetVirtualAddress;
+	uint32_t delta = targetVirtualAddress - patchVirtualAddress;
+	auto patchBits32 = [&](uint32_t mask, uint32_t bits)
+	{
+		uint32_t original = readBigEndian<uint32_t>(patchAddress);
+		writeBigEndian<uint32_t>(patchAddress, (original & ~mask) | (bits & mask));
+	};
+	switch (type)
+	{
+	case R_PPC_ADDR32:
+		writeBigEndian<uint32_t>(patchAddress, value);
+		break;
+	case R_PPC_ADDR24:
+		patchBits32(0x03FFFFFC, value);
+		break;
+	case R_PPC_ADDR16:
+	case R_PPC_ADDR16_LO:
+		writeBigEndian<uint16_t>(patchAddress, static_cast<uint16_t>(value));
+		break;
+	case R_PPC_ADDR16_HI:
+		writeBigEndian<uint16_t>(patchAddress, static_cast<uint16_t>(value >> 16));
+		break;
+	case R_PPC_ADDR16_HA:
+		writeBigEndian<uint16_t>(patchAddress, static_cast<uint16_t>((value + 0x8000) >> 16));
+		break;
+	case R_PPC_ADDR14:
+	case R_PPC_ADDR14_BRTAKEN:
+	case R_PPC_ADDR14_BRNKTAKEN:
+		patchBits32(0x0000FFFC, value);
+		break;
+	case R_PPC_REL24:
+		patchBits32(0x03FFFFFC, delta);
+		break;
+	case R_PPC_REL14:
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+		patchBits32(0x0000FFFC, delta);
+		break;
+	case R_PPC_REL32:
+		writeBigEndian<uint32_t>(patchAddress, delta);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
 
-	// Write final REL file
-	std::ofstream outputStream(relFilename, std::ios::binary);
-	outputStream.write(reinterpret_cast<const char *>(outputBuffer.data()), outputBuffer.size());
-	
-	return 0;
-}
\ No newline at end of file
+// lis r12, target@ha; addi r12, r12, target@l; mtctr r12; bctr
+const int cVeneerSize = 16;
+
+void writeVeneer(uint8_t *buffer, uint32_t targetVirtualAddress)
+{
+	writeBigEndian<uint32_t>(buffer, 0x3D800000 | ((targetVirtualAddress + 0x8000) >> 16));
+	writeBigEndian<uint32_t>(buffer + 4, 0x398C0000 | (targetVirtualAddress & 0xFFFF));
+	writeBigEndian<uint32_t>(buffer + 8, 0x7D8903A6);
+	writeBigEndian<uint32_t>(buffer + 12, 0x4E800420);
+}
+
+bool isAbsoluteRelocation(int type)
+{
+	switch (type)
+	{
+	case R_PPC_ADDR32:
+	case R_PPC_ADDR24:
+	case R_PPC_ADDR16:
+	case R_PPC_ADDR16_LO:
+	case R_PPC_ADDR16_HI:
+	case R_PPC_ADDR16_HA:
+	case R_PPC_ADDR14:
+	case R_PPC_ADDR14_BRTAKEN:
+	case R_PPC_ADDR14_BRNKTAKEN:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool isRelativeRelocation(int type)
+{
+	switch (type)
+	{
+	case R_PPC_REL24:
+	case R_PPC_REL14:
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+	case R_PPC_REL32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool isShortBranchRelocation(int type)
+{
+	return type == R_PPC_REL14 || type == R_PPC_REL14_BRTAKEN || type == R_PPC_REL14_BRNKTAKEN;
+}
+
+bool isSmallDataRelocation(int type)
+{
+	return type == R_PPC_SDAREL16 || type == R_PPC_EMB_SDA2REL || type == R_PPC_EMB_SDA21;
+}
+
+// Small data is addressed through r13 (_SDA_BASE_) or r2 (_SDA2_BASE_), a base
+// of 0 is unknown. SDA21 may also use r0 for targets in the first or last 32K
+// of the address space, which only makes sense for absolute addresses outside
+// of the module. Returns false if the target can't be reached.
+bool applySmallDataRelocation(uint8_t *data, uint32_t offset, int type, uint32_t targetVirtualAddress,
+							  uint32_t sdaBase, uint32_t sda2Base, bool allowAbsolute)
+{
+	auto isInReach = [](uint32_t delta)
+	{
+		int32_t signedDelta = static_cast<int32_t>(delta);
+		return signedDelta >= -0x8000 && signedDelta < 0x8000;
+	};
+	switch (type)
+	{
+	case R_PPC_SDAREL16:
+		if (!sdaBase || !isInReach(targetVirtualAddress - sdaBase))
+		{
+			return false;
+		}
+		writeBigEndian<uint16_t>(data + offset, static_cast<uint16_t>(targetVirtualAddress - sdaBase));
+		return true;
+	case R_PPC_EMB_SDA2REL:
+		if (!sda2Base || !isInReach(targetVirtualAddress - sda2Base))
+		{
+			return false;
+		}
+		writeBigEndian<uint16_t>(data + offset, static_cast<uint16_t>(targetVirtualAddress - sda2Base));
+		return true;
+	case R_PPC_EMB_SDA21:
+	{
+		// The base register is picked here and goes into the RA field
+		uint32_t baseRegister;
+		uint32_t value;
+		if (sdaBase && isInReach(targetVirtualAddress - sdaBase))
+		{
+			baseRegister = 13;
+			value = targetVirtualAddress - sdaBase;
+		}
+		else if (sda2Base && isInReach(targetVirtualAddress - sda2Base))
+		{
+			baseRegister = 2;
+			value = targetVirtualAddress - sda2Base;
+		}
+		else if (allowAbsolute && isInReach(targetVirtualAddress))
+		{
+			baseRegister = 0;
+			value = targetVirtualAddress;
+		}
+		else
+		{
+			return false;
+		}
+		// Offset may point at the low half of the instruction
+		uint8_t *instruction = data + (offset & ~3u);
+		uint32_t original = readBigEndian<uint32_t>(instruction);
+		writeBigEndian<uint32_t>(instruction, (original & ~0x001FFFFFu) | (baseRegister << 16) | (value & 0xFFFF));
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool isBranchInRange(int type, uint32_t delta)
+{
+	int32_t signedDelta = static_cast<int32_t>(delta);
+	switch (type)
+	{
+	case R_PPC_REL24:
+		return signedDelta >= -0x2000000 && signedDelta < 0x2000000;
+	case R_PPC_REL14:
+	case R_PPC_REL14_BRTAKEN:
+	case R_PPC_REL14_BRNKTAKEN:
+		return signedDelta >= -0x8000 && signedDelta < 0x8000;
+	default:
+		return true;
+	}
+}
+
+// Marks every section reachable through relocations from the given roots
+std::vector<char> findLiveSections(const ELFIO::elfio &elf,
+								   const SymbolTable &symbols,
+								   const std::vector<ELFIO::section *> &relocationSections,
+								   const std::vector<int> &rootSections,
+								   int threadCount)
+{
+	size_t sectionCount = elf.sections.size();
+
+	// Sections referenced by each relocation section, gathered in parallel
+	std::vector<std::vector<int>> references(relocationSections.size());
+	parallelFor(relocationSections.size(), threadCount, [&](size_t index)
+	{
+		ELFIO::relocation_section_accessor relocations(elf, relocationSections[index]);
+		std::vector<char> referenced(sectionCount, false);
+		for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+		{
+			ELFIO::Elf64_Addr offset;
+			ELFIO::Elf_Word symbol;
+			ELFIO::Elf_Word type;
+			ELFIO::Elf_Sxword addend;
+			relocations.get_entry(i, offset, symbol, type, addend);
+
+			// Undefined, absolute and common symbols don't keep anything alive
+			if (symbol < symbols.size() && symbols[symbol].sectionIndex < sectionCount)
+			{
+				referenced[symbols[symbol].sectionIndex] = true;
+			}
+		}
+		for (size_t i = 1; i < sectionCount; ++i)
+		{
+			if (referenced[i])
+			{
+				references[index].emplace_back(static_cast<int>(i));
+			}
+		}
+	});
+
+	std::vector<std::vector<int>> edges(sectionCount);
+	for (size_t i = 0; i < relocationSections.size(); ++i)
+	{
+		std::vector<int> &sectionEdges = edges[relocationSections[i]->get_info()];
+		sectionEdges.insert(sectionEdges.end(), references[i].begin(), references[i].end());
+	}
+
+	std::vector<char> live(sectionCount, false);
+	std::vector<int> pending;
+	for (int root : rootSections)
+	{
+		if (root > 0 && root < static_cast<int>(sectionCount) && !live[root])
+		{
+			live[root] = true;
+			pending.emplace_back(root);
+		}
+	}
+	while (!pending.empty())
+	{
+		int sectionIndex = pending.back();
+		pending.pop_back();
+		for (int target : edges[sectionIndex])
+		{
+			if (!live[target])
+			{
+				live[target] = true;
+				pending.emplace_back(target);
+			}
+		}
+	}
+	return live;
+}
+
+struct ConversionJob
+{
+	std::string elfFilename;
+	std::string relFilename;
+	int moduleID;
+	int relVersion;
+	int threadCount;
+	const SymbolMap *symbolMap;
+	const RelocationCache *cache; // Optional
+	// Pre-linking resolves every relocation it can for a fixed load address
+	bool prelink;
+	bool optimizeRelocations;
+	bool gcSections;
+	bool mergeSections;
+	bool fixedLayout;
+	uint32_t loadAddress;
+	uint32_t bssAddress; // 0 places BSS right after the loaded file
+	// Small data bases of the game, 0 looks up _SDA_BASE_/_SDA2_BASE_
+	uint32_t sdaBase;
+	uint32_t sda2Base;
+	// Route pre-linked branches that can't reach the game through veneers
+	bool branchVeneers;
+	// Unresolved symbols are warnings instead of errors
+	bool allowUnresolved;
+	// Optional symbol maps of the produced REL
+	std::string mapFilename;
+	std::string mapBinaryFilename;
+};
+
+struct ConversionStats
+{
+	int relocationSections = 0;
+	int cachedSections = 0;
+	size_t reusedRelocations = 0;
+	size_t writtenRelocations = 0;
+	size_t resolvedRelocations = 0;
+	int removedSections = 0;
+	size_t removedBytes = 0;
+	// Memory the module occupies permanently versus what OSLinkFixed can
+	// give back after linking (v3 only)
+	size_t fixedBytes = 0;
+	size_t reclaimableBytes = 0;
+	size_t bssBytes = 0;
+	// Long branch veneers and the branches routed through them
+	int veneers = 0;
+	size_t veneerBranches = 0;
+	// Time spent resolving the sections that were not cached
+	double computeMilliseconds = 0.0;
+	// Time the cached sections originally took, minus the time to load them
+	double savedMilliseconds = 0.0;
+
+	// Breakdown of the emitted import table and relocation stream
+	struct StreamUsage
+	{
+		size_t count = 0;
+		size_t bytes = 0;
+
+		void add(size_t entryCount, size_t entryBytes)
+		{
+			count += entryCount;
+			bytes += entryBytes;
+		}
+	};
+	StreamUsage importUsage;
+	std::map<std::string, StreamUsage> sectionUsage;
+	std::map<int, StreamUsage> typeUsage;
+
+	void add(const ConversionStats &other)
+	{
+		relocationSections += other.relocationSections;
+		cachedSections += other.cachedSections;
+		reusedRelocations += other.reusedRelocations;
+		writtenRelocations += other.writtenRelocations;
+		resolvedRelocations += other.resolvedRelocations;
+		removedSections += other.removedSections;
+		removedBytes += other.removedBytes;
+		fixedBytes += other.fixedBytes;
+		reclaimableBytes += other.reclaimableBytes;
+		bssBytes += other.bssBytes;
+		veneers += other.veneers;
+		veneerBranches += other.veneerBranches;
+		computeMilliseconds += other.computeMilliseconds;
+		savedMilliseconds += other.savedMilliseconds;
+		importUsage.add(other.importUsage.count, other.importUsage.bytes);
+		for (const auto &it : other.sectionUsage)
+		{
+			sectionUsage[it.first].add(it.second.count, it.second.bytes);
+		}
+		for (const auto &it : other.typeUsage)
+		{
+			typeUsage[it.first].add(it.second.count, it.second.bytes);
+		}
+	}
+};
+
+void printStats(const ConversionStats &stats)
+{
+	printf("Unreachable sections: %d removed, %u bytes\n",
+		   stats.removedSections,
+		   static_cast<uint32_t>(stats.removedBytes));
+	if (stats.fixedBytes)
+	{
+		printf("Heap: %u bytes fixed, %u bytes reclaimable by OSLinkFixed, %u bytes BSS%s\n",
+			   static_cast<uint32_t>(stats.fixedBytes),
+			   static_cast<uint32_t>(stats.reclaimableBytes),
+			   static_cast<uint32_t>(stats.bssBytes),
+			   stats.bssBytes && stats.bssBytes <= stats.reclaimableBytes ? " (fits in reclaimed memory)" : "");
+	}
+	if (stats.veneers)
+	{
+		printf("Veneers: %d inserted for %u out of range branches\n",
+			   stats.veneers,
+			   static_cast<uint32_t>(stats.veneerBranches));
+	}
+	printf("Relocations: %u written to REL, %u resolved during conversion\n",
+		   static_cast<uint32_t>(stats.writtenRelocations),
+		   static_cast<uint32_t>(stats.resolvedRelocations));
+	printf("Relocation sections: %d, %d from cache (%.1f%%), %u relocations reused\n",
+		   stats.relocationSections,
+		   stats.cachedSections,
+		   stats.relocationSections ? 100.0 * stats.cachedSections / stats.relocationSections : 0.0,
+		   static_cast<uint32_t>(stats.reusedRelocations));
+	printf("Relocation time: %.2f ms computed, %.2f ms saved by cache\n",
+		   stats.computeMilliseconds,
+		   stats.savedMilliseconds);
+
+	ConversionStats::StreamUsage streamUsage;
+	for (const auto &it : stats.typeUsage)
+	{
+		streamUsage.add(it.second.count, it.second.bytes);
+	}
+	printf("Relocation stream: %u entries, %u bytes, %u imports (%u bytes)\n",
+		   static_cast<uint32_t>(streamUsage.count),
+		   static_cast<uint32_t>(streamUsage.bytes),
+		   static_cast<uint32_t>(stats.importUsage.count),
+		   static_cast<uint32_t>(stats.importUsage.bytes));
+	printf("  By section:\n");
+	for (const auto &it : stats.sectionUsage)
+	{
+		printf("    %-24s %8u entries %10u bytes\n",
+			   it.first.c_str(),
+			   static_cast<uint32_t>(it.second.count),
+			   static_cast<uint32_t>(it.second.bytes));
+	}
+	printf("  By type:\n");
+	for (const auto &it : stats.typeUsage)
+	{
+		printf("    %-24s %8u entries %10u bytes\n",
+			   getRelocationTypeName(it.first),
+			   static_cast<uint32_t>(it.second.count),
+			   static_cast<uint32_t>(it.second.bytes));
+	}
+}
+
+bool convertElfToRel(const ConversionJob &job, Diagnostics &diagnostics, ConversionStats &stats)
+{
+	const SymbolMap &externalSymbolMap = *job.symbolMap;
+
+	// Load input file. Map it if possible so section data is only paged in
+	// for the sections we actually use, rather than copying the entire file.
+	namespace bip = boost::interprocess;
+	bip::file_mapping inputMapping;
+	bip::mapped_region inputRegion;
+	ELFIO::elfio inputElf;
+	bool inputLoaded;
+	try
+	{
+		inputMapping = bip::file_mapping(job.elfFilename.c_str(), bip::read_only);
+		inputRegion = bip::mapped_region(inputMapping, bip::read_only);
+		inputLoaded = inputElf.load(static_cast<const char *>(inputRegion.get_address()),
+									inputRegion.get_size());
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		inputLoaded = inputElf.load(job.elfFilename);
+	}
+	if (!inputLoaded)
+	{
+		diagnostics.report(DiagnosticSeverity::Error, "input-failed", "", "", "Failed to load input file '%s'", job.elfFilename.c_str());
+		return false;
+	}
+	
+	// Find special sections
+	ELFIO::section *symSection = nullptr;
+	std::vector<ELFIO::section *> relocationSections;
+	for (const auto &section : inputElf.sections)
+	{
+		if (section->get_type() == SHT_SYMTAB)
+		{
+			symSection = section;
+		}
+		else if (section->get_type() == SHT_RELA)
+		{
+			relocationSections.emplace_back(section);
+		}
+	}
+
+	if (inputElf.get_class() != ELFCLASS32 || !symSection)
+	{
+		diagnostics.report(DiagnosticSeverity::Error, "input-invalid", "", "", "Input file is not a 32-bit ELF with a symbol table");
+		return false;
+	}
+
+	// Index all symbols once up front
+	SymbolTable symbols(inputElf, symSection);
+
+	// Find prolog, epilog and unresolved
+	auto findSymbolSectionAndOffset = [&](const char *name, int &sectionIndex, int &offset)
+	{
+		const Symbol *symbol = symbols.find(name);
+		if (symbol)
+		{
+			sectionIndex = static_cast<int>(symbol->sectionIndex);
+			offset = static_cast<int>(symbol->value);
+		}
+	};
+
+	int prologSectionIndex = 0, prologOffset = 0;
+	findSymbolSectionAndOffset("_prolog", prologSectionIndex, prologOffset);
+	int epilogSectionIndex = 0, epilogOffset = 0;
+	findSymbolSectionAndOffset("_epilog", epilogSectionIndex, epilogOffset);
+	int unresolvedSectionIndex = 0, unresolvedOffset = 0;
+	findSymbolSectionAndOffset("_unresolved", unresolvedSectionIndex, unresolvedOffset);
+
+	// Only keep sections reachable from the entry points and static
+	// constructors/destructors if asked to
+	std::vector<char> liveSections(inputElf.sections.size(), true);
+	if (job.gcSections)
+	{
+		std::vector<int> rootSections = { prologSectionIndex, epilogSectionIndex, unresolvedSectionIndex };
+		for (const auto &section : inputElf.sections)
+		{
+			const std::string &name = section->get_name();
+			if (name == ".ctors" || name == ".dtors" || name.find(".ctors.") == 0 || name.find(".dtors.") == 0)
+			{
+				rootSections.emplace_back(section->get_index());
+			}
+		}
+		liveSections = findLiveSections(inputElf, symbols, relocationSections, rootSections, job.threadCount);
+	}
+
+	// Decide which sections make it into the REL at all
+	std::vector<char> keptSections(inputElf.sections.size(), false);
+	for (const auto &section : inputElf.sections)
+	{
+		if (!findRelSectionKind(section->get_name()))
+		{
+			// Section was removed
+		}
+		else if (!liveSections[section->get_index()])
+		{
+			// Section is unreachable
+			++stats.removedSections;
+			stats.removedBytes += static_cast<size_t>(section->get_size());
+		}
+		else
+		{
+			keptSections[section->get_index()] = true;
+		}
+	}
+
+	// Group sections into REL sections. Normally every ELF section becomes its
+	// own REL section under the same index. When merging, all kept sections of
+	// a kind are coalesced into one REL section.
+	std::vector<std::vector<ELFIO::section *>> sectionGroups;
+	std::vector<std::string> sectionNames;
+	if (!job.mergeSections)
+	{
+		for (const auto &section : inputElf.sections)
+		{
+			sectionGroups.emplace_back();
+			if (keptSections[section->get_index()])
+			{
+				sectionGroups.back().emplace_back(section);
+			}
+			sectionNames.emplace_back(section->get_name());
+		}
+	}
+	else
+	{
+		// Keep section 0 empty like in every REL
+		sectionGroups.emplace_back();
+		sectionNames.emplace_back("");
+		for (const auto &kind : cRelSectionMask)
+		{
+			for (bool bss : { false, true })
+			{
+				std::vector<ELFIO::section *> group;
+				for (const auto &section : inputElf.sections)
+				{
+					const std::string *sectionKind = findRelSectionKind(section->get_name());
+					if (keptSections[section->get_index()]
+						&& *sectionKind == kind
+						&& (section->get_type() == SHT_NOBITS) == bss)
+					{
+						group.emplace_back(section);
+					}
+				}
+				if (group.empty())
+				{
+					continue;
+				}
+
+				// Constructor and destructor order matters. Everything else goes
+				// from most to least aligned, leaving as little padding as possible.
+				if (kind != ".ctors" && kind != ".dtors")
+				{
+					std::stable_sort(group.begin(), group.end(), [](ELFIO::section *left, ELFIO::section *right)
+					{
+						return left->get_addr_align() > right->get_addr_align();
+					});
+				}
+				sectionGroups.emplace_back(std::move(group));
+				sectionNames.emplace_back(kind);
+			}
+		}
+	}
+
+	// Veneers get a section of their own after everything else. It's only
+	// sized once the relocations are known.
+	int veneerSection = 0;
+	if (job.branchVeneers)
+	{
+		veneerSection = static_cast<int>(sectionGroups.size());
+		sectionGroups.emplace_back();
+		sectionNames.emplace_back(".veneers");
+	}
+
+	// Lay out sections first so the output only needs to be allocated once
+	struct SectionInfo
+	{
+		int offset;
+		int size;
+	};
+	std::vector<SectionInfo> sectionInfos;
+	sectionInfos.reserve(sectionGroups.size());
+	std::map<ELFIO::section *, int> writtenSections;
+	// Which REL section each ELF section ended up in, and where inside of it
+	std::vector<int> outputSectionIndices(inputElf.sections.size(), 0);
+	std::vector<int> outputSectionOffsets(inputElf.sections.size(), 0);
+	if (!job.mergeSections)
+	{
+		std::iota(outputSectionIndices.begin(), outputSectionIndices.end(), 0);
+	}
+	int totalBssSize = 0;
+	int maxAlign = 2;
+	int maxBssAlign = 2;
+	int sectionInfoOffset = static_cast<int>(getModuleHeaderSize(job.relVersion));
+	int outputSize = sectionInfoOffset + sectionGroups.size() * 8;
+	for (size_t groupIndex = 0; groupIndex < sectionGroups.size(); ++groupIndex)
+	{
+		const auto &group = sectionGroups[groupIndex];
+		if (group.empty())
+		{
+			sectionInfos.push_back({ 0, 0 });
+			continue;
+		}
+
+		// BSS?
+		if (group.front()->get_type() == SHT_NOBITS)
+		{
+			int size = 0;
+			for (const auto &section : group)
+			{
+				// Update max alignment
+				int align = std::max(static_cast<int>(section->get_addr_align()), 1);
+				maxBssAlign = std::max(maxBssAlign, align);
+
+				size = (size + align - 1) & ~(align - 1);
+				outputSectionIndices[section->get_index()] = static_cast<int>(groupIndex);
+				outputSectionOffsets[section->get_index()] = size;
+				size += static_cast<int>(section->get_size());
+			}
+			totalBssSize += size;
+			sectionInfos.push_back({ 0, size });
+		}
+		else
+		{
+			// Update max alignment (minimum 2, low offset bit is used for exec flag)
+			int align = 2;
+			bool executable = false;
+			for (const auto &section : group)
+			{
+				align = std::max(align, static_cast<int>(section->get_addr_align()));
+				executable = executable || (section->get_flags() & SHF_EXECINSTR);
+			}
+			maxAlign = std::max(maxAlign, align);
+
+			// Skip padding
+			int offset = (outputSize + align - 1) & ~(align - 1);
+
+			int size = 0;
+			for (const auto &section : group)
+			{
+				int sectionAlign = std::max(static_cast<int>(section->get_addr_align()), 1);
+				size = (size + sectionAlign - 1) & ~(sectionAlign - 1);
+				outputSectionIndices[section->get_index()] = static_cast<int>(groupIndex);
+				outputSectionOffsets[section->get_index()] = size;
+				writtenSections[section] = offset + size;
+				size += static_cast<int>(section->get_size());
+			}
+
+			int encodedOffset = offset;
+			// Mark executable sections
+			if (executable)
+			{
+				encodedOffset |= 1;
+			}
+			sectionInfos.push_back({ encodedOffset, size });
+
+			outputSize = offset + size;
+		}
+	}
+
+	// Modules relocations can target, sorted by ID so the import table is too
+	std::vector<uint32_t> importModules = { 0, static_cast<uint32_t>(job.moduleID) };
+	std::sort(importModules.begin(), importModules.end());
+	importModules.erase(std::unique(importModules.begin(), importModules.end()), importModules.end());
+	uint8_t externalModuleSlot = static_cast<uint8_t>(
+		std::find(importModules.begin(), importModules.end(), 0u) - importModules.begin());
+	uint8_t selfModuleSlot = static_cast<uint8_t>(
+		std::find(importModules.begin(), importModules.end(), static_cast<uint32_t>(job.moduleID)) - importModules.begin());
+
+	// Everything outside of a relocation section that decides how it resolves.
+	// Symbols are keyed by what they are rather than by their index, together
+	// with the section they are in, so a run only misses the cache when a
+	// symbol it references changes, not whenever anything in the module does.
+	uint64_t resolutionDigest = 0;
+	std::vector<uint64_t> sectionDigests;
+	std::vector<uint64_t> symbolDigests;
+	if (job.cache)
+	{
+		uint64_t symbolMapDigest = externalSymbolMap.getDigest();
+		resolutionDigest = hashBytes(&job.moduleID, sizeof(job.moduleID));
+		resolutionDigest = hashBytes(&symbolMapDigest, sizeof(symbolMapDigest), resolutionDigest);
+
+		sectionDigests.reserve(inputElf.sections.size());
+		for (const auto &section : inputElf.sections)
+		{
+			// Section names and types show up in messages
+			const std::string &name = section->get_name();
+			uint8_t written = writtenSections.find(section) != writtenSections.end();
+			ELFIO::Elf_Word type = section->get_type();
+			uint64_t digest = hashBytes(name.c_str(), name.size() + 1);
+			digest = hashBytes(&written, sizeof(written), digest);
+			digest = hashBytes(&type, sizeof(type), digest);
+			sectionDigests.emplace_back(digest);
+		}
+
+		symbolDigests.reserve(symbols.size());
+		for (size_t i = 0; i < symbols.size(); ++i)
+		{
+			const Symbol &symbol = symbols[i];
+			uint64_t digest = hashBytes(symbol.name, strlen(symbol.name) + 1);
+			digest = hashBytes(&symbol.value, sizeof(symbol.value), digest);
+			digest = hashBytes(&symbol.sectionIndex, sizeof(symbol.sectionIndex), digest);
+			if (symbol.sectionIndex < sectionDigests.size())
+			{
+				digest = hashBytes(&sectionDigests[symbol.sectionIndex], sizeof(uint64_t), digest);
+			}
+			symbolDigests.emplace_back(digest);
+		}
+	}
+
+	// Find all relocations. Relocation sections are independent of each other,
+	// so each one is collected into its own sorted run and the runs merged.
+	std::vector<std::vector<Relocation>> runs(relocationSections.size());
+	std::vector<Diagnostics> runDiagnostics(relocationSections.size());
+	std::vector<char> runFailed(relocationSections.size(), false);
+	std::vector<ConversionStats> runStats(relocationSections.size());
+	parallelFor(relocationSections.size(), job.threadCount, [&](size_t runIndex)
+	{
+		ELFIO::section *section = relocationSections[runIndex];
+		std::vector<Relocation> &run = runs[runIndex];
+
+		int relocatedSectionIndex = section->get_info();
+		ELFIO::section *relocatedSection = inputElf.sections[relocatedSectionIndex];
+		// Only relocate sections that were written
+		if (writtenSections.find(relocatedSection) == writtenSections.end())
+		{
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto getElapsedMilliseconds = [&]()
+		{
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			return elapsed.count();
+		};
+		runStats[runIndex].relocationSections = 1;
+
+		uint64_t cacheKey = 0;
+		if (job.cache)
+		{
+			cacheKey = hashBytes(&relocatedSectionIndex, sizeof(relocatedSectionIndex), resolutionDigest);
+			cacheKey = hashBytes(&sectionDigests[relocatedSectionIndex], sizeof(uint64_t), cacheKey);
+
+			// The entries with their symbol index replaced by the symbol
+			ELFIO::relocation_section_accessor relocations(inputElf, section);
+			for (ELFIO::Elf_Xword i = 0; i < relocations.get_entries_num(); ++i)
+			{
+				ELFIO::Elf64_Addr offset;
+				ELFIO::Elf_Word symbol;
+				ELFIO::Elf_Word type;
+				ELFIO::Elf_Sxword addend;
+				relocations.get_entry(i, offset, symbol, type, addend);
+
+				uint64_t symbolDigest = symbol < symbolDigests.size() ? symbolDigests[symbol] : symbol;
+				cacheKey = hashBytes(&offset, sizeof(offset), cacheKey);
+				cacheKey = hashBytes(&type, sizeof(type), cacheKey);
+				cacheKey = hashBytes(&addend, sizeof(addend), cacheKey);
+				cacheKey = hashBytes(&symbolDigest, sizeof(symbolDigest), cacheKey);
+			}
+
+			RelocationCache::Entry entry;
+			if (job.cache->lookup(cacheKey, entry) && runDiagnostics[runIndex].deserialize(entry.diagnostics))
+			{
+				run = std::move(entry.relocations);
+
+				ConversionStats &runStat = runStats[runIndex];
+				runStat.cachedSections = 1;
+				runStat.reusedRelocations = run.size();
+				runStat.savedMilliseconds = entry.computeMicroseconds / 1000.0 - getElapsedMilliseconds();
+				return;
+			}
+		}
+
+		ELFIO::relocation_section_accessor relocations(inputElf, section);
+		run.reserve(static_cast<size_t>(relocations.get_entries_num()));
+		// #todo-elf2rel: Process relocations
+		for (int i = 0; i < relocations.get_entries_num(); ++i)
+		{
+			ELFIO::Elf64_Addr offset;
+			ELFIO::Elf_Word symbol;
+			ELFIO::Elf_Word type;
+			ELFIO::Elf_Sxword addend;
+			relocations.get_entry(i, offset, symbol, type, addend);
+
+			// Ignore R_PPC_NONE
+			if (type == R_PPC_NONE)
+				continue;
+
+			if (symbol >= symbols.size())
+			{
+				runDiagnostics[runIndex].report(DiagnosticSeverity::Error,
+												"symbol-missing",
+												"",
+												relocatedSection->get_name(),
+												"Unable to find symbol %u in symbol table",
+												static_cast<uint32_t>(symbol));
+				runFailed[runIndex] = true;
+				return;
+			}
+			const char *symbolName = symbols[symbol].name;
+			uint32_t symbolValue = symbols[symbol].value;
+			uint16_t sectionIndex = symbols[symbol].sectionIndex;
+
+			// Add relocation to list
+			bool resolved = false;
+			Relocation rel;
+			rel.section = static_cast<uint16_t>(relocatedSectionIndex);
+			rel.offset = static_cast<uint32_t>(offset);
+			rel.type = static_cast<uint8_t>(type);
+			if (sectionIndex)
+			{
+				// Self-relocation
+				resolved = true;
+
+				rel.moduleSlot = selfModuleSlot;
+				rel.targetSection = sectionIndex;
+				rel.addend = static_cast<uint32_t>(addend + symbolValue);
+
+				ELFIO::section *targetSection = inputElf.sections[rel.targetSection];
+				if (writtenSections.find(targetSection) == writtenSections.end() && targetSection->get_type() != SHT_NOBITS)
+				{
+					runDiagnostics[runIndex].report(DiagnosticSeverity::Warning,
+													"unwritten-section",
+													symbolName,
+													relocatedSection->get_name(),
+													"Relocation against symbol '%s' in unwritten section '%s'",
+													symbolName,
+													targetSection->get_name().c_str());
+				}
+			}
+			else
+			{
+				// Symbol is unknown, check if it's an external known symbol
+				uint32_t externalAddress;
+				if (externalSymbolMap.find(symbolName, externalAddress))
+				{
+					// Known external!
+					resolved = true;
+
+					rel.moduleSlot = externalModuleSlot;
+					rel.targetSection = 0; // #todo-elf2rel: Check if this is important
+					rel.addend = static_cast<uint32_t>(addend + externalAddress);
+				}
+			}
+
+			if (resolved)
+			{
+				run.emplace_back(rel);
+			}
+			else
+			{
+				runDiagnostics[runIndex].report(DiagnosticSeverity::Error,
+												"unresolved-symbol",
+												symbolName,
+												relocatedSection->get_name(),
+												"Unresolved external symbol '%s'",
+												symbolName);
+			}
+		}
+
+		sortRelocations(run);
+
+		double computeMilliseconds = getElapsedMilliseconds();
+		runStats[runIndex].computeMilliseconds = computeMilliseconds;
+		if (job.cache)
+		{
+			RelocationCache::Entry entry;
+			entry.relocations = run;
+			entry.diagnostics = runDiagnostics[runIndex].serialize();
+			entry.computeMicroseconds = static_cast<uint32_t>(computeMilliseconds * 1000.0);
+			job.cache->store(cacheKey, entry);
+		}
+	});
+
+	// Report in section order so the output doesn't depend on scheduling
+	for (size_t i = 0; i < runs.size(); ++i)
+	{
+		stats.add(runStats[i]);
+		diagnostics.merge(runDiagnostics[i]);
+		if (runFailed[i])
+		{
+			return false;
+		}
+	}
+
+	// Near misses in the symbol map usually mean a typo or a changed signature
+	for (auto &diagnostic : diagnostics.getDiagnostics())
+	{
+		if (diagnostic.code == "unresolved-symbol")
+		{
+			diagnostic.suggestions = externalSymbolMap.findSimilar(diagnostic.subject.c_str(), 3);
+		}
+	}
+	if (job.allowUnresolved)
+	{
+		diagnostics.setSeverity("unresolved-symbol", DiagnosticSeverity::Warning);
+	}
+
+	std::vector<Relocation> allRelocations = mergeRelocationRuns(runs);
+
+	// OSLink knows nothing about small data, those relocations are resolved
+	// against the game's r13 and r2 here
+	std::vector<Relocation> smallDataRelocations;
+	std::copy_if(allRelocations.begin(), allRelocations.end(), std::back_inserter(smallDataRelocations),
+				 [](const Relocation &rel) { return isSmallDataRelocation(rel.type); });
+	if (!smallDataRelocations.empty())
+	{
+		allRelocations.erase(std::remove_if(allRelocations.begin(), allRelocations.end(),
+											[](const Relocation &rel) { return isSmallDataRelocation(rel.type); }),
+							 allRelocations.end());
+	}
+	uint32_t sdaBase = job.sdaBase;
+	uint32_t sda2Base = job.sda2Base;
+	if (!sdaBase)
+	{
+		externalSymbolMap.find("_SDA_BASE_", sdaBase);
+	}
+	if (!sda2Base)
+	{
+		externalSymbolMap.find("_SDA2_BASE_", sda2Base);
+	}
+
+	// Count modules
+	int importCount = 0;
+	int lastModuleSlot = -1;
+	for (const auto &rel : allRelocations)
+	{
+		if (lastModuleSlot != rel.moduleSlot)
+		{
+			lastModuleSlot = rel.moduleSlot;
+			++importCount;
+		}
+	}
+
+	// Branches within the module are resolved right away and never reach the
+	// REL. This keeps the sort order for both halves.
+	auto isResolvedEarly = [&](const Relocation &rel)
+	{
+		return importModules[rel.moduleSlot] == static_cast<uint32_t>(job.moduleID)
+			   && (rel.type == R_PPC_REL24 || rel.type == R_PPC_REL32 || isShortBranchRelocation(rel.type));
+	};
+	std::vector<Relocation> earlyRelocations;
+	std::copy_if(allRelocations.begin(), allRelocations.end(), std::back_inserter(earlyRelocations), isResolvedEarly);
+	allRelocations.erase(std::remove_if(allRelocations.begin(), allRelocations.end(), isResolvedEarly),
+						 allRelocations.end());
+
+	// Relocations against absolute external addresses don't depend on where
+	// the module is loaded, and with a known load address nothing does. Those
+	// are applied here rather than by OSLink.
+	auto isPrelinkable = [&](const Relocation &rel)
+	{
+		bool external = rel.moduleSlot == externalModuleSlot && externalModuleSlot != selfModuleSlot;
+		if (job.prelink)
+		{
+			if (!external)
+			{
+				ELFIO::section *targetSection = inputElf.sections[rel.targetSection];
+				if (writtenSections.find(targetSection) == writtenSections.end()
+					&& targetSection->get_type() != SHT_NOBITS)
+				{
+					return false;
+				}
+			}
+			return isAbsoluteRelocation(rel.type) || isRelativeRelocation(rel.type);
+		}
+		return job.optimizeRelocations && external && isAbsoluteRelocation(rel.type);
+	};
+	std::vector<Relocation> prelinkedRelocations;
+	if (job.prelink || job.optimizeRelocations)
+	{
+		std::copy_if(allRelocations.begin(), allRelocations.end(), std::back_inserter(prelinkedRelocations), isPrelinkable);
+		allRelocations.erase(std::remove_if(allRelocations.begin(), allRelocations.end(), isPrelinkable),
+							 allRelocations.end());
+
+		if (job.optimizeRelocations)
+		{
+			// Identical relocations would patch the same bytes the same way twice
+			allRelocations.erase(std::unique(allRelocations.begin(), allRelocations.end(),
+											 [](const Relocation &left, const Relocation &right)
+			{
+				return left.offset == right.offset
+					   && left.addend == right.addend
+					   && left.moduleSlot == right.moduleSlot
+					   && left.section == right.section
+					   && left.targetSection == right.targetSection
+					   && left.type == right.type;
+			}), allRelocations.end());
+		}
+
+		// Only modules still referenced need an import
+		importCount = 0;
+		lastModuleSlot = -1;
+		for (const auto &rel : allRelocations)
+		{
+			if (lastModuleSlot != rel.moduleSlot)
+			{
+				lastModuleSlot = rel.moduleSlot;
+				++importCount;
+			}
+		}
+	}
+
+	// #todo-elf2rel: Add runtime unresolved symbol handling here
+	// At this point, only symbols that OSLink can handle should remain
+	for (const auto &rel : allRelocations)
+	{
+		switch (rel.type)
+		{
+		case R_PPC_NONE:
+		case R_PPC_ADDR32:
+		case R_PPC_ADDR24:
+		case R_PPC_ADDR16:
+		case R_PPC_ADDR16_LO:
+		case R_PPC_ADDR16_HI:
+		case R_PPC_ADDR16_HA:
+		case R_PPC_ADDR14:
+		case R_PPC_ADDR14_BRTAKEN:
+		case R_PPC_ADDR14_BRNKTAKEN:
+		case R_PPC_REL24:
+		case R_DOLPHIN_NOP:
+		case R_DOLPHIN_SECTION:
+		case R_DOLPHIN_END:
+			break;
+		default:
+			diagnostics.report(DiagnosticSeverity::Error,
+							   "unsupported-relocation",
+							   "",
+							   inputElf.sections[rel.section]->get_name(),
+							   "Unsupported relocation type %s (%d)",
+							   getRelocationTypeName(rel.type),
+							   rel.type);
+			break;
+		}
+	}
+
+	// A REL24 only reaches 32MB either way. Pre-linked branches into the game
+	// that don't make it are sent to a veneer that jumps through ctr instead,
+	// one per target.
+	std::map<uint32_t, uint32_t> veneerAddresses;
+	if (job.branchVeneers)
+	{
+		std::map<uint32_t, size_t> veneerTargets;
+		for (const auto &rel : prelinkedRelocations)
+		{
+			bool external = rel.moduleSlot == externalModuleSlot && externalModuleSlot != selfModuleSlot;
+			uint32_t patchVirtualAddress = job.loadAddress + writtenSections.at(inputElf.sections[rel.section]) + rel.offset;
+			if (external && rel.type == R_PPC_REL24 && !isBranchInRange(rel.type, rel.addend - patchVirtualAddress))
+			{
+				++veneerTargets[rel.addend];
+			}
+		}
+
+		if (!veneerTargets.empty())
+		{
+			int veneerOffset = (outputSize + cVeneerSize - 1) & ~(cVeneerSize - 1);
+			int veneerSize = static_cast<int>(veneerTargets.size()) * cVeneerSize;
+			sectionInfos[veneerSection] = { veneerOffset | 1, veneerSize };
+			outputSize = veneerOffset + veneerSize;
+			maxAlign = std::max(maxAlign, cVeneerSize);
+
+			uint32_t veneerAddress = job.loadAddress + veneerOffset;
+			for (const auto &it : veneerTargets)
+			{
+				diagnostics.report(DiagnosticSeverity::Note,
+								   "veneer",
+								   "",
+								   "",
+								   "Veneer at %08x for %u branches to %08x",
+								   veneerAddress,
+								   static_cast<uint32_t>(it.second),
+								   it.first);
+				veneerAddresses[it.first] = veneerAddress;
+				veneerAddress += cVeneerSize;
+				stats.veneerBranches += it.second;
+			}
+			stats.veneers = static_cast<int>(veneerTargets.size());
+		}
+	}
+
+	// Relocations so far refer to ELF sections, move them into the REL ones.
+	// Only those have to fit the single byte REL relocations address sections
+	// by, ELF sections past that are fine as long as they end up merged.
+	bool sectionLimitExceeded = false;
+	for (auto &rel : allRelocations)
+	{
+		bool self = rel.moduleSlot == selfModuleSlot;
+		int outputSection = outputSectionIndices[rel.section];
+		int outputTargetSection = self ? outputSectionIndices[rel.targetSection] : rel.targetSection;
+		if (outputSection > 0xFF || outputTargetSection > 0xFF)
+		{
+			const std::string &sectionName = inputElf.sections[rel.section]->get_name();
+			const std::string &limitedName = outputSection > 0xFF
+				? sectionName
+				: inputElf.sections[rel.targetSection]->get_name();
+			diagnostics.report(DiagnosticSeverity::Error,
+							   "section-limit",
+							   "",
+							   sectionName,
+							   "Section '%s' is past the REL section limit, relocations %s it can't be encoded",
+							   limitedName.c_str(),
+							   outputSection > 0xFF ? "from" : "into");
+			sectionLimitExceeded = true;
+			continue;
+		}
+
+		if (job.mergeSections)
+		{
+			rel.offset += outputSectionOffsets[rel.section];
+			if (self)
+			{
+				rel.addend += outputSectionOffsets[rel.targetSection];
+			}
+		}
+		rel.section = static_cast<uint16_t>(outputSection);
+		rel.targetSection = static_cast<uint16_t>(outputTargetSection);
+	}
+	if (sectionLimitExceeded)
+	{
+		return false;
+	}
+	if (job.mergeSections)
+	{
+		sortRelocations(allRelocations);
+	}
+
+	// Size the relocation stream so the whole file can be laid out up front
+	size_t relocationEntryCount = 0;
+	generateRelocationStream(allRelocations, importModules,
+							 [](uint32_t) {},
+							 [&](int, int, int, uint32_t) { ++relocationEntryCount; });
+
+	// Imports are 8 byte aligned. The regular layout always pads, even when
+	// already aligned, and is kept that way so its output doesn't change.
+	bool tightImports = job.optimizeRelocations || job.fixedLayout;
+	int importInfoOffset = tightImports ? (outputSize + 7) & ~7 : (outputSize + 8) & ~7;
+	int relocationOffset = importInfoOffset + importCount * 8;
+	size_t totalSize = relocationOffset + relocationEntryCount * 8;
+
+	// Imports and relocations are only needed while linking. Only our own
+	// module and module 0 are ever imported, so once OSLinkFixed is done
+	// everything past the section data can go back to the heap.
+	int fixedDataSize = job.fixedLayout ? outputSize : relocationOffset;
+	if (job.relVersion >= 3)
+	{
+		stats.fixedBytes = fixedDataSize;
+		stats.reclaimableBytes = totalSize - fixedDataSize;
+		stats.bssBytes = totalBssSize;
+	}
+	stats.writtenRelocations = allRelocations.size();
+	stats.resolvedRelocations = earlyRelocations.size() + prelinkedRelocations.size() + smallDataRelocations.size();
+
+	// Everything not explicitly written, including padding, stays zeroed
+	std::vector<uint8_t> outputBuffer(totalSize);
+	uint8_t *sectionInfoCursor = &outputBuffer[sectionInfoOffset];
+	for (const auto &info : sectionInfos)
+	{
+		sectionInfoCursor = writeSectionInfo(sectionInfoCursor, info.offset, info.size);
+	}
+
+	// Copy section data straight from the input
+	for (const auto &it : writtenSections)
+	{
+		const char *sectionData = it.first->get_data();
+		std::copy(sectionData, sectionData + it.first->get_size(), outputBuffer.begin() + it.second);
+	}
+
+	for (const auto &it : veneerAddresses)
+	{
+		writeVeneer(&outputBuffer[it.second - job.loadAddress], it.first);
+	}
+
+	for (const Relocation &rel : earlyRelocations)
+	{
+		int offset = writtenSections.at(inputElf.sections[rel.section]) + rel.offset;
+		int delta = writtenSections.at(inputElf.sections[rel.targetSection]) + rel.addend - offset;
+		uint8_t *patchAddress = &outputBuffer[offset];
+
+		if (rel.type == R_PPC_REL24)
+		{
+			if (!isBranchInRange(rel.type, delta))
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "branch-out-of-range",
+								   "",
+								   inputElf.sections[rel.section]->get_name(),
+								   "Branch from section '%s' offset %x to section '%s' is out of range",
+								   inputElf.sections[rel.section]->get_name().c_str(),
+								   rel.offset,
+								   inputElf.sections[rel.targetSection]->get_name().c_str());
+			}
+			writeBigEndian<uint32_t>(patchAddress, readBigEndian<uint32_t>(patchAddress) | (delta & 0x03FFFFFC));
+		}
+		else if (rel.type == R_PPC_REL32)
+		{
+			writeBigEndian<uint32_t>(patchAddress, delta);
+		}
+		else if (isShortBranchRelocation(rel.type))
+		{
+			if (!isBranchInRange(rel.type, delta))
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "branch-out-of-range",
+								   "",
+								   inputElf.sections[rel.section]->get_name(),
+								   "Conditional branch from section '%s' offset %x to section '%s' is out of range",
+								   inputElf.sections[rel.section]->get_name().c_str(),
+								   rel.offset,
+								   inputElf.sections[rel.targetSection]->get_name().c_str());
+			}
+			writeBigEndian<uint32_t>(patchAddress, readBigEndian<uint32_t>(patchAddress) | (delta & 0x0000FFFC));
+		}
+	}
+
+	// Self relocations are only pre-linked with a known load address
+	std::vector<uint32_t> sectionAddresses(inputElf.sections.size(), 0);
+	if (job.prelink)
+	{
+		// OSLink hands out BSS to the sections in order from a single block
+		uint32_t bssAddress = job.bssAddress;
+		if (!bssAddress)
+		{
+			bssAddress = (job.loadAddress + static_cast<uint32_t>(totalSize) + maxBssAlign - 1) & ~(maxBssAlign - 1);
+		}
+		std::vector<uint32_t> outputSectionAddresses(sectionInfos.size(), 0);
+		for (size_t i = 0; i < sectionInfos.size(); ++i)
+		{
+			if (sectionInfos[i].offset)
+			{
+				outputSectionAddresses[i] = job.loadAddress + (sectionInfos[i].offset & ~1);
+			}
+			else if (sectionInfos[i].size)
+			{
+				outputSectionAddresses[i] = bssAddress;
+				bssAddress += sectionInfos[i].size;
+			}
+		}
+		for (const auto &section : inputElf.sections)
+		{
+			if (keptSections[section->get_index()])
+			{
+				sectionAddresses[section->get_index()] = outputSectionAddresses[outputSectionIndices[section->get_index()]]
+														 + outputSectionOffsets[section->get_index()];
+			}
+		}
+	}
+
+	for (const Relocation &rel : prelinkedRelocations)
+	{
+		int offset = writtenSections.at(inputElf.sections[rel.section]) + rel.offset;
+		// Only meaningful when pre-linking, absolute relocations ignore it
+		uint32_t patchVirtualAddress = job.loadAddress + offset;
+		uint32_t targetVirtualAddress = rel.addend;
+		if (rel.moduleSlot == selfModuleSlot)
+		{
+			targetVirtualAddress += sectionAddresses[rel.targetSection];
+		}
+
+		if (!isBranchInRange(rel.type, targetVirtualAddress - patchVirtualAddress))
+		{
+			auto veneer = veneerAddresses.find(targetVirtualAddress);
+			if (rel.type == R_PPC_REL24 && veneer != veneerAddresses.end())
+			{
+				targetVirtualAddress = veneer->second;
+			}
+			else
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "branch-out-of-range",
+								   "",
+								   inputElf.sections[rel.section]->get_name(),
+								   "Branch from section '%s' offset %x to %08x is out of range",
+								   inputElf.sections[rel.section]->get_name().c_str(),
+								   rel.offset,
+								   targetVirtualAddress);
+			}
+		}
+		applyRelocation(&outputBuffer[offset], rel.type, patchVirtualAddress, targetVirtualAddress);
+	}
+
+	for (const Relocation &rel : smallDataRelocations)
+	{
+		int offset = writtenSections.at(inputElf.sections[rel.section]) + rel.offset;
+		uint32_t targetVirtualAddress = rel.addend;
+		bool external = rel.moduleSlot == externalModuleSlot && externalModuleSlot != selfModuleSlot;
+		if (!external)
+		{
+			// The module's own small data is only reachable at a known address
+			if (!job.prelink)
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "small-data-needs-load-address",
+								   "",
+								   inputElf.sections[rel.section]->get_name(),
+								   "Small data relocation from section '%s' offset %x into the module needs a load address",
+								   inputElf.sections[rel.section]->get_name().c_str(),
+								   rel.offset);
+				continue;
+			}
+			// .sdata and friends are not laid out in the REL, so they have no address
+			ELFIO::section *targetSection = inputElf.sections[rel.targetSection];
+			if (!keptSections[rel.targetSection])
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "small-data-unplaced-section",
+								   "",
+								   inputElf.sections[rel.section]->get_name(),
+								   "Small data relocation from section '%s' offset %x into section '%s', which is not part of the REL; "
+								   "the module's own small data sections are not supported, build with -G0",
+								   inputElf.sections[rel.section]->get_name().c_str(),
+								   rel.offset,
+								   targetSection->get_name().c_str());
+				continue;
+			}
+			targetVirtualAddress += sectionAddresses[rel.targetSection];
+		}
+
+		if (!applySmallDataRelocation(outputBuffer.data(), offset, rel.type, targetVirtualAddress, sdaBase, sda2Base, external))
+		{
+			diagnostics.report(DiagnosticSeverity::Error,
+							   "small-data-out-of-reach",
+							   "",
+							   inputElf.sections[rel.section]->get_name(),
+							   "Small data relocation from section '%s' offset %x to %08x is out of reach",
+							   inputElf.sections[rel.section]->get_name().c_str(),
+							   rel.offset,
+							   targetVirtualAddress);
+		}
+	}
+
+	// Write out imports and relocations
+	uint8_t *importCursor = &outputBuffer[importInfoOffset];
+	uint8_t *relocationCursor = &outputBuffer[relocationOffset];
+	std::string streamSectionName = "(none)";
+	generateRelocationStream(allRelocations, importModules,
+							 [&](uint32_t moduleID)
+	{
+		int listOffset = static_cast<int>(relocationCursor - outputBuffer.data());
+		importCursor = writeImportInfo(importCursor, moduleID, listOffset);
+		stats.importUsage.add(1, 8);
+	},
+							 [&](int offset, int type, int section, uint32_t addend)
+	{
+		relocationCursor = writeRelocation(relocationCursor, offset, type, section, addend);
+		if (type == R_DOLPHIN_SECTION)
+		{
+			streamSectionName = sectionNames[section];
+		}
+		stats.sectionUsage[streamSectionName].add(1, 8);
+		stats.typeUsage[type].add(1, 8);
+	});
+	int importInfoSize = static_cast<int>(importCursor - &outputBuffer[importInfoOffset]);
+
+	// Entry points may also be in special sections, those are passed through
+	auto getOutputSectionIndex = [&](int sectionIndex)
+	{
+		return sectionIndex < static_cast<int>(outputSectionIndices.size()) ? outputSectionIndices[sectionIndex] : sectionIndex;
+	};
+	auto getOutputSectionOffset = [&](int sectionIndex)
+	{
+		return sectionIndex < static_cast<int>(outputSectionOffsets.size()) ? outputSectionOffsets[sectionIndex] : 0;
+	};
+
+	// Write final header
+	RelModuleHeader header = RelModuleHeader();
+	header.id = job.moduleID;
+	header.sectionCount = static_cast<uint32_t>(sectionInfos.size());
+	header.sectionInfoOffset = sectionInfoOffset;
+	header.version = job.relVersion;
+	header.totalBssSize = totalBssSize;
+	header.relocationOffset = relocationOffset;
+	header.importInfoOffset = importInfoOffset;
+	header.importInfoSize = importInfoSize;
+	header.prologSection = static_cast<uint8_t>(getOutputSectionIndex(prologSectionIndex));
+	header.epilogSection = static_cast<uint8_t>(getOutputSectionIndex(epilogSectionIndex));
+	header.unresolvedSection = static_cast<uint8_t>(getOutputSectionIndex(unresolvedSectionIndex));
+	header.prologOffset = prologOffset + getOutputSectionOffset(prologSectionIndex);
+	header.epilogOffset = epilogOffset + getOutputSectionOffset(epilogSectionIndex);
+	header.unresolvedOffset = unresolvedOffset + getOutputSectionOffset(unresolvedSectionIndex);
+	header.maxAlign = maxAlign;
+	header.maxBssAlign = maxBssAlign;
+	header.fixedDataSize = fixedDataSize;
+	writeModuleHeader(outputBuffer.data(), header);
+
+	// A REL with errors would only fail later on the console
+	if (diagnostics.getCount(DiagnosticSeverity::Error))
+	{
+		return false;
+	}
+
+	// Write final REL file
+	std::ofstream outputStream(job.relFilename, std::ios::binary);
+	outputStream.write(reinterpret_cast<const char *>(outputBuffer.data()), outputBuffer.size());
+	if (!outputStream.good())
+	{
+		return false;
+	}
+
+	if (job.mapFilename != "" || job.mapBinaryFilename != "")
+	{
+		// Functions and variables by where they ended up in the REL
+		RelSymbolMap relMap(static_cast<uint32_t>(job.moduleID), static_cast<uint32_t>(sectionInfos.size()));
+		bool mapSectionLimitExceeded = false;
+		for (size_t i = 0; i < symbols.size(); ++i)
+		{
+			const Symbol &symbol = symbols[i];
+			if ((symbol.type != STT_FUNC && symbol.type != STT_OBJECT)
+				|| symbol.name[0] == '\0'
+				|| symbol.sectionIndex == SHN_UNDEF
+				|| symbol.sectionIndex >= inputElf.sections.size()
+				|| !keptSections[symbol.sectionIndex])
+			{
+				continue;
+			}
+			// Maps address sections by a single byte, like relocations do
+			int outputSection = outputSectionIndices[symbol.sectionIndex];
+			if (outputSection > 0xFF)
+			{
+				const std::string &sectionName = inputElf.sections[symbol.sectionIndex]->get_name();
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "section-limit",
+								   "",
+								   sectionName,
+								   "Section '%s' is past the REL section limit, its symbols can't be mapped",
+								   sectionName.c_str());
+				mapSectionLimitExceeded = true;
+				continue;
+			}
+			relMap.add(static_cast<uint8_t>(outputSection),
+					   outputSectionOffsets[symbol.sectionIndex] + symbol.value,
+					   symbol.size,
+					   symbol.type,
+					   symbol.name);
+		}
+		if (!veneerAddresses.empty() && veneerSection > 0xFF)
+		{
+			diagnostics.report(DiagnosticSeverity::Error,
+							   "section-limit",
+							   "",
+							   "",
+							   "Veneer section %d is past the REL section limit of the symbol map",
+							   veneerSection);
+			mapSectionLimitExceeded = true;
+		}
+		if (mapSectionLimitExceeded)
+		{
+			return false;
+		}
+		for (const auto &it : veneerAddresses)
+		{
+			char name[32];
+			snprintf(name, sizeof(name), "veneer_%08x", it.first);
+			uint32_t sectionAddress = job.loadAddress + (sectionInfos[veneerSection].offset & ~1);
+			relMap.add(static_cast<uint8_t>(veneerSection), it.second - sectionAddress, cVeneerSize, STT_FUNC, name);
+		}
+		relMap.finalize();
+
+		if (job.mapFilename != "" && !relMap.saveText(job.mapFilename))
+		{
+			diagnostics.report(DiagnosticSeverity::Error, "map-failed", "", "", "Failed to write symbol map '%s'", job.mapFilename.c_str());
+			return false;
+		}
+		if (job.mapBinaryFilename != "" && !relMap.saveBinary(job.mapBinaryFilename))
+		{
+			diagnostics.report(DiagnosticSeverity::Error,
+							   "map-failed",
+							   "",
+							   "",
+							   "Failed to write symbol map '%s'",
+							   job.mapBinaryFilename.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct LinkJob
+{
+	std::string inputFilename;
+	std::string outputFilename;
+	uint32_t baseAddress;
+	uint32_t bssAddress; // 0 places BSS right after the loaded file
+	// Section addresses of other modules already in memory
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> moduleSectionAddresses;
+};
+
+// Applies every import of an existing REL for a fixed load address, like
+// OSLink would on the console, and drops the import and relocation tables.
+bool linkRel(const LinkJob &job, Diagnostics &diagnostics, size_t &relocationCount)
+{
+	std::ifstream inputStream(job.inputFilename, std::ios::binary);
+	if (!inputStream)
+	{
+		diagnostics.report(DiagnosticSeverity::Error, "input-failed", "", "", "Failed to open input file");
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+
+	RelModuleHeader header;
+	if (!readModuleHeader(data.data(), data.size(), header)
+		|| header.sectionInfoOffset > data.size()
+		|| header.sectionCount > (data.size() - header.sectionInfoOffset) / 8
+		|| header.importInfoOffset > data.size()
+		|| header.importInfoSize > data.size() - header.importInfoOffset)
+	{
+		diagnostics.report(DiagnosticSeverity::Error, "input-invalid", "", "", "Input file is not a valid REL");
+		return false;
+	}
+
+	// OSLink hands out BSS to the sections in order from a single block
+	uint32_t bssAddress = job.bssAddress;
+	if (!bssAddress)
+	{
+		uint32_t bssAlign = std::max(header.maxBssAlign, 1u);
+		bssAddress = (job.baseAddress + static_cast<uint32_t>(data.size()) + bssAlign - 1) & ~(bssAlign - 1);
+	}
+	std::vector<uint32_t> sectionAddresses(header.sectionCount, 0);
+	std::vector<uint32_t> sectionOffsets(header.sectionCount, 0);
+	for (uint32_t i = 0; i < header.sectionCount; ++i)
+	{
+		const uint8_t *info = &data[header.sectionInfoOffset + i * 8];
+		uint32_t offset = readBigEndian<uint32_t>(info) & ~1u;
+		uint32_t size = readBigEndian<uint32_t>(info + 4);
+		sectionOffsets[i] = offset;
+		if (offset)
+		{
+			sectionAddresses[i] = job.baseAddress + offset;
+		}
+		else if (size)
+		{
+			sectionAddresses[i] = bssAddress;
+			bssAddress += size;
+		}
+	}
+
+	// Imports are read from the original, patches only ever touch section data
+	const std::vector<uint8_t> original = data;
+	for (uint32_t importIndex = 0; importIndex < header.importInfoSize / 8; ++importIndex)
+	{
+		const uint8_t *import = &original[header.importInfoOffset + importIndex * 8];
+		uint32_t moduleID = readBigEndian<uint32_t>(import);
+		uint32_t entryOffset = readBigEndian<uint32_t>(import + 4);
+
+		uint32_t currentSection = 0;
+		uint32_t currentOffset = 0;
+		for (;; entryOffset += 8)
+		{
+			if (entryOffset > original.size() || original.size() - entryOffset < 8)
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "relocation-list-invalid",
+								   "",
+								   "",
+								   "Relocation list for module %u runs past end of file",
+								   moduleID);
+				return false;
+			}
+			const uint8_t *entry = &original[entryOffset];
+			currentOffset += readBigEndian<uint16_t>(entry);
+			int type = entry[2];
+			uint32_t targetSection = entry[3];
+			uint32_t addend = readBigEndian<uint32_t>(entry + 4);
+
+			if (type == R_DOLPHIN_END)
+			{
+				break;
+			}
+			if (type == R_DOLPHIN_SECTION)
+			{
+				currentSection = targetSection;
+				currentOffset = 0;
+				continue;
+			}
+			if (type == R_DOLPHIN_NOP || type == R_PPC_NONE)
+			{
+				continue;
+			}
+
+			uint32_t targetAddress = addend;
+			if (moduleID == header.id)
+			{
+				if (targetSection >= header.sectionCount)
+				{
+					diagnostics.report(DiagnosticSeverity::Error,
+									   "section-missing",
+									   "",
+									   "",
+									   "Relocation against missing section %u",
+									   targetSection);
+					continue;
+				}
+				targetAddress += sectionAddresses[targetSection];
+			}
+			else if (moduleID != 0)
+			{
+				auto it = job.moduleSectionAddresses.find(std::make_pair(moduleID, targetSection));
+				if (it == job.moduleSectionAddresses.end())
+				{
+					diagnostics.report(DiagnosticSeverity::Error,
+									   "module-address-missing",
+									   "",
+									   "",
+									   "No address given for module %u section %u",
+									   moduleID,
+									   targetSection);
+					continue;
+				}
+				targetAddress += it->second;
+			}
+
+			if (currentSection >= header.sectionCount
+				|| !sectionOffsets[currentSection]
+				|| static_cast<size_t>(sectionOffsets[currentSection]) + currentOffset + 4 > data.size())
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "relocation-outside-file",
+								   "",
+								   "",
+								   "Relocation at %u:0x%x is outside of the file",
+								   currentSection,
+								   currentOffset);
+				continue;
+			}
+			uint32_t patchOffset = sectionOffsets[currentSection] + currentOffset;
+			uint32_t patchAddress = sectionAddresses[currentSection] + currentOffset;
+			if (!isBranchInRange(type, targetAddress - patchAddress))
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "branch-out-of-range",
+								   "",
+								   "",
+								   "Branch at %u:0x%x to %08x is out of range",
+								   currentSection,
+								   currentOffset,
+								   targetAddress);
+			}
+			if (!applyRelocation(&data[patchOffset], type, patchAddress, targetAddress))
+			{
+				diagnostics.report(DiagnosticSeverity::Error,
+								   "unsupported-relocation",
+								   "",
+								   "",
+								   "Unsupported relocation type %s (%d)",
+								   getRelocationTypeName(type),
+								   type);
+				continue;
+			}
+			++relocationCount;
+		}
+	}
+
+	// Nothing is left for OSLink to do
+	writeBigEndian<uint32_t>(&data[0x24], 0); // relocation offset
+	writeBigEndian<uint32_t>(&data[0x28], 0); // import offset
+	writeBigEndian<uint32_t>(&data[0x2C], 0); // import size
+
+	if (diagnostics.getCount(DiagnosticSeverity::Error))
+	{
+		return false;
+	}
+
+	std::ofstream outputStream(job.outputFilename, std::ios::binary);
+	outputStream.write(reinterpret_cast<const char *>(data.data()), data.size());
+	return outputStream.good();
+}
+
+// Diagnostics of one job in the JSON report
+std::string formatJobJson(const std::string &inputFilename,
+						  const std::string &outputFilename,
+						  bool success,
+						  const Diagnostics &diagnostics)
+{
+	char counts[64];
+	snprintf(counts, sizeof(counts), "\"errors\": %d, \"warnings\": %d",
+			 diagnostics.getCount(DiagnosticSeverity::Error),
+			 diagnostics.getCount(DiagnosticSeverity::Warning));
+
+	std::string json = "{\"input\": " + escapeJsonString(inputFilename);
+	json += ", \"output\": " + escapeJsonString(outputFilename);
+	json += success ? ", \"success\": true, " : ", \"success\": false, ";
+	json += counts;
+	json += ", \"diagnostics\": " + diagnostics.formatJson() + "}";
+	return json;
+}
+
+bool writeDiagnosticsJson(const std::string &filename, const std::vector<std::string> &jobJsons)
+{
+	std::ofstream outputStream(filename);
+	outputStream << "{\"jobs\": [";
+	for (size_t i = 0; i < jobJsons.size(); ++i)
+	{
+		outputStream << (i ? ",\n" : "\n") << jobJsons[i];
+	}
+	outputStream << "\n]}\n";
+	return outputStream.good();
+}
+
+int runManifest(const std::string &manifestFilename,
+				int relVersion,
+				int threadCount,
+				const RelocationCache *cache,
+				bool optimizeRelocations,
+				bool gcSections,
+				bool mergeSections,
+				bool fixedLayout,
+				bool allowUnresolved,
+				const std::string &diagnosticsFilename,
+				bool printJobStats)
+{
+	// One job per line: <input ELF> <output REL> <REL ID> <symbol file>
+	std::ifstream manifestStream(manifestFilename);
+	if (!manifestStream)
+	{
+		printf("Failed to open manifest '%s'\n", manifestFilename.c_str());
+		return 1;
+	}
+
+	std::vector<ConversionJob> jobs;
+	std::map<std::string, std::unique_ptr<SymbolMap>> symbolMaps;
+	int lineNumber = 0;
+	for (std::string line; std::getline(manifestStream, line); )
+	{
+		++lineNumber;
+
+		std::istringstream lineStream(line);
+		std::string elfFilename, relFilename, moduleIDString, symbolFilename;
+		if (!(lineStream >> elfFilename) || elfFilename[0] == '#')
+		{
+			continue;
+		}
+		if (!(lineStream >> relFilename >> moduleIDString >> symbolFilename))
+		{
+			printf("%s:%d: Expected <input ELF> <output REL> <REL ID> <symbol file>\n",
+				   manifestFilename.c_str(),
+				   lineNumber);
+			return 1;
+		}
+
+		// Every symbol file is only loaded once, no matter how many jobs use it
+		auto &symbolMap = symbolMaps[symbolFilename];
+		if (!symbolMap)
+		{
+			symbolMap.reset(new SymbolMap());
+			if (!symbolMap->loadFile(symbolFilename))
+			{
+				printf("Failed to load symbol file '%s'\n", symbolFilename.c_str());
+				return 1;
+			}
+		}
+
+		ConversionJob job;
+		job.elfFilename = elfFilename;
+		job.relFilename = relFilename;
+		job.moduleID = static_cast<int>(strtol(moduleIDString.c_str(), nullptr, 0));
+		job.relVersion = relVersion;
+		// Jobs already run in parallel, don't oversubscribe inside of them
+		job.threadCount = 1;
+		job.symbolMap = symbolMap.get();
+		job.cache = cache;
+		job.prelink = false;
+		job.optimizeRelocations = optimizeRelocations;
+		job.gcSections = gcSections;
+		job.mergeSections = mergeSections;
+		job.fixedLayout = fixedLayout;
+		job.loadAddress = 0;
+		job.bssAddress = 0;
+		// Each symbol file provides the small data bases of its game
+		job.sdaBase = 0;
+		job.sda2Base = 0;
+		job.branchVeneers = false;
+		job.allowUnresolved = allowUnresolved;
+		jobs.emplace_back(job);
+	}
+	if (jobs.empty())
+	{
+		printf("Manifest '%s' lists no jobs\n", manifestFilename.c_str());
+		return 1;
+	}
+
+	if (threadCount <= 0)
+	{
+		threadCount = getDefaultThreadCount();
+	}
+
+	struct JobResult
+	{
+		bool success;
+		Diagnostics diagnostics;
+		double milliseconds;
+		ConversionStats stats;
+	};
+	std::vector<JobResult> results(jobs.size());
+
+	auto batchStart = std::chrono::steady_clock::now();
+	parallelFor(jobs.size(), threadCount, [&](size_t jobIndex)
+	{
+		JobResult &result = results[jobIndex];
+		auto start = std::chrono::steady_clock::now();
+		result.success = convertElfToRel(jobs[jobIndex], result.diagnostics, result.stats);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		result.milliseconds = elapsed.count();
+	});
+	std::chrono::duration<double, std::milli> batchElapsed = std::chrono::steady_clock::now() - batchStart;
+
+	// Report in manifest order regardless of completion order
+	int failedCount = 0;
+	ConversionStats totalStats;
+	std::vector<std::string> jobJsons;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		totalStats.add(results[i].stats);
+		printf("%s", results[i].diagnostics.formatText().c_str());
+		jobJsons.emplace_back(formatJobJson(jobs[i].elfFilename,
+											jobs[i].relFilename,
+											results[i].success,
+											results[i].diagnostics));
+		printf("%s -> %s: %s in %.2f ms\n",
+			   jobs[i].elfFilename.c_str(),
+			   jobs[i].relFilename.c_str(),
+			   results[i].success ? "done" : "FAILED",
+			   results[i].milliseconds);
+		if (!results[i].success)
+		{
+			++failedCount;
+		}
+	}
+	printf("%d jobs (%d failed) on %d threads in %.2f ms\n",
+		   static_cast<int>(jobs.size()),
+		   failedCount,
+		   static_cast<int>(getWorkerCount(jobs.size(), threadCount)),
+		   batchElapsed.count());
+	if (printJobStats)
+	{
+		printStats(totalStats);
+	}
+
+	if (diagnosticsFilename != "" && !writeDiagnosticsJson(diagnosticsFilename, jobJsons))
+	{
+		printf("Failed to write diagnostics to '%s'\n", diagnosticsFilename.c_str());
+		return 1;
+	}
+
+	return failedCount ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	std::string elfFilename;
+	std::string lstFilename;
+	std::string relFilename = "";
+	std::string symbolDatabaseFilename;
+	std::string manifestFilename;
+	int moduleID = 33;
+	int relVersion = 3;
+	int threadCount = 0;
+	std::string cacheDirectory;
+	bool printJobStats = false;
+	std::string loadAddressString;
+	std::string bssAddressString;
+	std::string sdaBaseString;
+	std::string sda2BaseString;
+	bool optimizeRelocations = false;
+	bool gcSections = false;
+	bool mergeSections = false;
+	bool fixedLayout = false;
+	bool branchVeneers = false;
+	bool allowUnresolved = false;
+	std::string diagnosticsFilename;
+	std::string mapFilename;
+	std::string mapBinaryFilename;
+	std::string linkFilename;
+	std::vector<std::string> moduleAddressStrings;
+
+	{
+		namespace po = boost::program_options;
+
+		po::options_description description("Options");
+		description.add_options()
+			("help", "Print help message")
+			("input-file,i", po::value(&elfFilename), "Input ELF filename (required)")
+			("symbol-file,s", po::value(&lstFilename), "Input symbol file or symbol database name (required)")
+			("write-symbol-db", po::value(&symbolDatabaseFilename), "Compile the symbol file into a symbol database")
+			("output-file,o", po::value(&relFilename), "Output REL filename")
+			("rel-id", po::value(&moduleID)->default_value(0x1000), "REL file ID")
+			("rel-version", po::value(&relVersion)->default_value(3), "REL file format version (1, 2, 3)")
+			("manifest", po::value(&manifestFilename), "Convert every job listed in a manifest file instead")
+			("jobs,j", po::value(&threadCount)->default_value(0), "Worker threads (0 = one per core)")
+			("cache-dir", po::value(&cacheDirectory), "Reuse relocations of unchanged sections from this directory")
+			("stats", po::bool_switch(&printJobStats), "Print relocation and cache statistics")
+			("allow-unresolved", po::bool_switch(&allowUnresolved), "Treat unresolved symbols as warnings and still write the REL")
+			("diagnostics-json", po::value(&diagnosticsFilename), "Also write all errors and warnings to this file as JSON")
+			("write-map", po::value(&mapFilename), "Write the REL's own symbols by section and offset as text")
+			("write-map-bin", po::value(&mapBinaryFilename), "Write the REL's own symbols in the binary form used on the console")
+			("load-address", po::value(&loadAddressString), "Pre-link for this load address, leaving almost nothing for OSLink")
+			("bss-address", po::value(&bssAddressString), "BSS address when pre-linking (default: right after the REL)")
+			("sda-base", po::value(&sdaBaseString), "Game r13 for small data relocations (default: _SDA_BASE_ from the symbol file)")
+			("sda2-base", po::value(&sda2BaseString), "Game r2 for small data relocations (default: _SDA2_BASE_ from the symbol file)")
+			("branch-veneers", po::bool_switch(&branchVeneers), "Route pre-linked branches that can't reach the game through veneers")
+			("optimize-relocations", po::bool_switch(&optimizeRelocations), "Resolve what doesn't need OSLink and emit a minimal relocation table")
+			("gc-sections", po::bool_switch(&gcSections), "Remove sections unreachable from _prolog, _epilog, _unresolved and static constructors/destructors")
+			("merge-sections", po::bool_switch(&mergeSections), "Coalesce all sections of a kind (.text.*, .rodata.*, ...) into one REL section")
+			("fixed-layout", po::bool_switch(&fixedLayout), "Let OSLinkFixed reclaim everything past the section data (v3)")
+			("link-rel", po::value(&linkFilename), "Statically link an existing REL to --load-address instead")
+			("module-address", po::value(&moduleAddressStrings), "Section address of another module for --link-rel, as <id>:<section>=<address>");
+
+		po::positional_options_description positionals;
+		positionals.add("input-file", -1);
+
+		po::variables_map varMap;
+		po::store(
+			po::command_line_parser(argc, argv)
+				.options(description)
+				.positional(positionals)
+				.run(),
+			varMap
+		);
+		po::notify(varMap);
+
+		bool manifestMode = varMap.count("manifest") == 1;
+		bool linkMode = varMap.count("link-rel") == 1;
+		bool convertMode = !manifestMode && !linkMode;
+		if (varMap.count("help")
+			|| (convertMode && varMap.count("input-file") != 1 && varMap.count("write-symbol-db") != 1)
+			|| (convertMode && varMap.count("symbol-file") != 1)
+			|| (linkMode && (manifestMode || varMap.count("input-file") != 0 || varMap.count("load-address") != 1))
+			|| (manifestMode && varMap.count("input-file") != 0)
+			|| (manifestMode && varMap.count("load-address") != 0)
+			|| (manifestMode && (varMap.count("sda-base") != 0 || varMap.count("sda2-base") != 0))
+			|| (manifestMode && (varMap.count("write-map") != 0 || varMap.count("write-map-bin") != 0))
+			|| (varMap.count("bss-address") != 0 && varMap.count("load-address") == 0)
+			|| (branchVeneers && varMap.count("load-address") == 0)
+			|| relVersion < 1
+			|| relVersion > 3)
+		{
+			std::cout << description << "\n";
+			return 1;
+		}
+	}
+
+	if (linkFilename != "")
+	{
+		LinkJob job;
+		job.inputFilename = linkFilename;
+		job.outputFilename = relFilename != "" ? relFilename : linkFilename + ".linked";
+		job.baseAddress = static_cast<uint32_t>(strtoul(loadAddressString.c_str(), nullptr, 0));
+		job.bssAddress = static_cast<uint32_t>(strtoul(bssAddressString.c_str(), nullptr, 0));
+		for (const auto &moduleAddress : moduleAddressStrings)
+		{
+			char *cursor;
+			uint32_t id = static_cast<uint32_t>(strtoul(moduleAddress.c_str(), &cursor, 0));
+			if (*cursor != ':')
+			{
+				printf("Expected <id>:<section>=<address>, got '%s'\n", moduleAddress.c_str());
+				return 1;
+			}
+			uint32_t section = static_cast<uint32_t>(strtoul(cursor + 1, &cursor, 0));
+			if (*cursor != '=')
+			{
+				printf("Expected <id>:<section>=<address>, got '%s'\n", moduleAddress.c_str());
+				return 1;
+			}
+			job.moduleSectionAddresses[std::make_pair(id, section)] = static_cast<uint32_t>(strtoul(cursor + 1, nullptr, 0));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		Diagnostics diagnostics;
+		size_t relocationCount = 0;
+		bool success = linkRel(job, diagnostics, relocationCount);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		printf("%s", diagnostics.formatText().c_str());
+		if (diagnosticsFilename != ""
+			&& !writeDiagnosticsJson(diagnosticsFilename,
+									 { formatJobJson(job.inputFilename, job.outputFilename, success, diagnostics) }))
+		{
+			printf("Failed to write diagnostics to '%s'\n", diagnosticsFilename.c_str());
+			return 1;
+		}
+		if (printJobStats)
+		{
+			printf("Linked %u relocations in %.2f ms\n", static_cast<uint32_t>(relocationCount), elapsed.count());
+		}
+		return success ? 0 : 1;
+	}
+
+	RelocationCache cache;
+	if (cacheDirectory != "" && !cache.open(cacheDirectory))
+	{
+		printf("Failed to open cache directory '%s'\n", cacheDirectory.c_str());
+		return 1;
+	}
+	const RelocationCache *cachePointer = cache.isOpen() ? &cache : nullptr;
+
+	if (manifestFilename != "")
+	{
+		return runManifest(manifestFilename,
+						   relVersion,
+						   threadCount,
+						   cachePointer,
+						   optimizeRelocations,
+						   gcSections,
+						   mergeSections,
+						   fixedLayout,
+						   allowUnresolved,
+						   diagnosticsFilename,
+						   printJobStats);
+	}
+
+	SymbolMap externalSymbolMap;
+	if (!externalSymbolMap.loadFile(lstFilename))
+	{
+		printf("Failed to load symbol file\n");
+		return 1;
+	}
+
+	if (symbolDatabaseFilename != "")
+	{
+		if (!externalSymbolMap.saveDatabase(symbolDatabaseFilename))
+		{
+			printf("Failed to write symbol database\n");
+			return 1;
+		}
+
+		// Only compiling the database?
+		if (elfFilename == "")
+		{
+			return 0;
+		}
+	}
+
+	if (relFilename == "")
+	{
+		relFilename = elfFilename.substr(0, elfFilename.find_last_of('.')) + ".rel";
+	}
+
+	ConversionJob job;
+	job.elfFilename = elfFilename;
+	job.relFilename = relFilename;
+	job.moduleID = moduleID;
+	job.relVersion = relVersion;
+	job.threadCount = threadCount > 0 ? threadCount : getDefaultThreadCount();
+	job.symbolMap = &externalSymbolMap;
+	job.cache = cachePointer;
+	job.prelink = loadAddressString != "";
+	job.optimizeRelocations = optimizeRelocations;
+	job.gcSections = gcSections;
+	job.mergeSections = mergeSections;
+	job.fixedLayout = fixedLayout;
+	job.loadAddress = static_cast<uint32_t>(strtoul(loadAddressString.c_str(), nullptr, 0));
+	job.bssAddress = static_cast<uint32_t>(strtoul(bssAddressString.c_str(), nullptr, 0));
+	job.sdaBase = static_cast<uint32_t>(strtoul(sdaBaseString.c_str(), nullptr, 0));
+	job.sda2Base = static_cast<uint32_t>(strtoul(sda2BaseString.c_str(), nullptr, 0));
+	job.branchVeneers = branchVeneers;
+	job.allowUnresolved = allowUnresolved;
+	job.mapFilename = mapFilename;
+	job.mapBinaryFilename = mapBinaryFilename;
+
+	Diagnostics diagnostics;
+	ConversionStats stats;
+	bool success = convertElfToRel(job, diagnostics, stats);
+	printf("%s", diagnostics.formatText().c_str());
+	int errorCount = diagnostics.getCount(DiagnosticSeverity::Error);
+	int warningCount = diagnostics.getCount(DiagnosticSeverity::Warning);
+	if (errorCount || warningCount)
+	{
+		printf("%d errors, %d warnings\n", errorCount, warningCount);
+	}
+	if (diagnosticsFilename != ""
+		&& !writeDiagnosticsJson(diagnosticsFilename,
+								 { formatJobJson(job.elfFilename, job.relFilename, success, diagnostics) }))
+	{
+		printf("Failed to write diagnostics to '%s'\n", diagnosticsFilename.c_str());
+		return 1;
+	}
+	if (printJobStats)
+	{
+		printStats(stats);
+	}
+
+	return success ? 0 : 1;
+}
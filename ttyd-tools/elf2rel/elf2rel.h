@@ -4,6 +4,8 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
 enum RelRelocationType
 {
@@ -19,30 +21,178 @@ enum RelRelocationType
 	R_PPC_ADDR14_BRNKTAKEN,
 	R_PPC_REL24,
 	R_PPC_REL14,
+	R_PPC_REL14_BRTAKEN,
+	R_PPC_REL14_BRNKTAKEN,
 
 	R_PPC_REL32 = 26,
+	R_PPC_SDAREL16 = 32,
+
+	R_PPC_EMB_SDA2REL = 108,
+	R_PPC_EMB_SDA21,
 
 	R_DOLPHIN_NOP = 201,
 	R_DOLPHIN_SECTION,
 	R_DOLPHIN_END,
 };
 
+inline const char *getRelocationTypeName(int type)
+{
+	switch (type)
+	{
+	case R_PPC_NONE: return "R_PPC_NONE";
+	case R_PPC_ADDR32: return "R_PPC_ADDR32";
+	case R_PPC_ADDR24: return "R_PPC_ADDR24";
+	case R_PPC_ADDR16: return "R_PPC_ADDR16";
+	case R_PPC_ADDR16_LO: return "R_PPC_ADDR16_LO";
+	case R_PPC_ADDR16_HI: return "R_PPC_ADDR16_HI";
+	case R_PPC_ADDR16_HA: return "R_PPC_ADDR16_HA";
+	case R_PPC_ADDR14: return "R_PPC_ADDR14";
+	case R_PPC_ADDR14_BRTAKEN: return "R_PPC_ADDR14_BRTAKEN";
+	case R_PPC_ADDR14_BRNKTAKEN: return "R_PPC_ADDR14_BRNKTAKEN";
+	case R_PPC_REL24: return "R_PPC_REL24";
+	case R_PPC_REL14: return "R_PPC_REL14";
+	case R_PPC_REL14_BRTAKEN: return "R_PPC_REL14_BRTAKEN";
+	case R_PPC_REL14_BRNKTAKEN: return "R_PPC_REL14_BRNKTAKEN";
+	case R_PPC_REL32: return "R_PPC_REL32";
+	case R_PPC_SDAREL16: return "R_PPC_SDAREL16";
+	case R_PPC_EMB_SDA2REL: return "R_PPC_EMB_SDA2REL";
+	case R_PPC_EMB_SDA21: return "R_PPC_EMB_SDA21";
+	case R_DOLPHIN_NOP: return "R_DOLPHIN_NOP";
+	case R_DOLPHIN_SECTION: return "R_DOLPHIN_SECTION";
+	case R_DOLPHIN_END: return "R_DOLPHIN_END";
+	default: return "unknown";
+	}
+}
+
+// Packed to 16 bytes to keep sorting and emission cache friendly. Sections
+// are ELF section indices until the output layout is applied, so they need
+// more than the single byte a REL has for them.
+struct Relocation
+{
+	uint32_t offset;
+	uint32_t addend;
+	uint16_t section;
+	uint16_t targetSection;
+	uint8_t moduleSlot; // Index into the sorted list of target modules
+	uint8_t type;
+};
+static_assert(sizeof(Relocation) == 16, "Relocation should be packed");
+
 template<typename T>
-void save(std::vector<uint8_t> &buffer, const T &value)
+T readBigEndian(const uint8_t *data)
 {
-	for (size_t i = sizeof(T); i > 0; --i)
+	T value = 0;
+	for (size_t i = 0; i < sizeof(T); ++i)
 	{
-		buffer.emplace_back(static_cast<uint8_t>((value >> (i - 1) * 8) & 0xFF));
+		value = static_cast<T>((value << 8) | data[i]);
 	}
+	return value;
 }
 
 template<typename T>
-void load(std::vector<uint8_t> &buffer, T &value)
+void writeBigEndian(uint8_t *data, T value)
 {
-	value = 0;
 	for (size_t i = sizeof(T); i > 0; --i)
 	{
-		value |= static_cast<T>(buffer.front()) << ((i - 1) * 8);
-		buffer.erase(buffer.begin());
+		data[i - 1] = static_cast<uint8_t>(value & 0xFF);
+		value = static_cast<T>(value >> 8);
+	}
+}
+
+// 32-bit FNV-1a
+inline uint32_t hashString(const char *begin, const char *end)
+{
+	uint32_t hash = 2166136261u;
+	for (; begin != end; ++begin)
+	{
+		hash = (hash ^ static_cast<uint8_t>(*begin)) * 16777619u;
+	}
+	return hash;
+}
+
+// 64-bit FNV-1a, chain calls by passing the previous result as seed
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
 	}
-}
\ No newline at end of file
+	return hash;
+}
+
+// Module header as stored at the start of every REL. Fields past
+// unresolvedOffset only exist from the version noted on them.
+struct RelModuleHeader
+{
+	uint32_t id;
+	uint32_t sectionCount;
+	uint32_t sectionInfoOffset;
+	uint32_t nameOffset;
+	uint32_t nameSize;
+	uint32_t version;
+	uint32_t totalBssSize;
+	uint32_t relocationOffset;
+	uint32_t importInfoOffset;
+	uint32_t importInfoSize;
+	uint8_t prologSection;
+	uint8_t epilogSection;
+	uint8_t unresolvedSection;
+	uint32_t prologOffset;
+	uint32_t epilogOffset;
+	uint32_t unresolvedOffset;
+	uint32_t maxAlign; // v2
+	uint32_t maxBssAlign; // v2
+	uint32_t fixedDataSize; // v3
+};
+
+inline size_t getModuleHeaderSize(int version)
+{
+	if (version >= 3)
+		return 0x4C;
+	if (version >= 2)
+		return 0x48;
+	return 0x40;
+}
+
+// Returns false if the data is too small for the header it claims to have
+inline bool readModuleHeader(const uint8_t *data, size_t size, RelModuleHeader &header)
+{
+	if (size < getModuleHeaderSize(1))
+	{
+		return false;
+	}
+
+	header = RelModuleHeader();
+	header.id = readBigEndian<uint32_t>(data + 0x00);
+	header.sectionCount = readBigEndian<uint32_t>(data + 0x0C);
+	header.sectionInfoOffset = readBigEndian<uint32_t>(data + 0x10);
+	header.nameOffset = readBigEndian<uint32_t>(data + 0x14);
+	header.nameSize = readBigEndian<uint32_t>(data + 0x18);
+	header.version = readBigEndian<uint32_t>(data + 0x1C);
+	header.totalBssSize = readBigEndian<uint32_t>(data + 0x20);
+	header.relocationOffset = readBigEndian<uint32_t>(data + 0x24);
+	header.importInfoOffset = readBigEndian<uint32_t>(data + 0x28);
+	header.importInfoSize = readBigEndian<uint32_t>(data + 0x2C);
+	header.prologSection = data[0x30];
+	header.epilogSection = data[0x31];
+	header.unresolvedSection = data[0x32];
+	header.prologOffset = readBigEndian<uint32_t>(data + 0x34);
+	header.epilogOffset = readBigEndian<uint32_t>(data + 0x38);
+	header.unresolvedOffset = readBigEndian<uint32_t>(data + 0x3C);
+
+	if (size < getModuleHeaderSize(header.version))
+	{
+		return false;
+	}
+	if (header.version >= 2)
+	{
+		header.maxAlign = readBigEndian<uint32_t>(data + 0x40);
+		header.maxBssAlign = readBigEndian<uint32_t>(data + 0x44);
+	}
+	if (header.version >= 3)
+	{
+		header.fixedDataSize = readBigEndian<uint32_t>(data + 0x48);
+	}
+	return true;
+}
@@ -67,6 +67,52 @@ set_##FNAME( TYPE val )                            \
 
 namespace ELFIO {
 
+//------------------------------------------------------------------------------
+// Read-only stream buffer over an in-memory file image
+class image_streambuf : public std::streambuf
+{
+  public:
+//------------------------------------------------------------------------------
+    image_streambuf( const char* image, Elf64_Off image_size )
+    {
+        char* begin = const_cast<char*>( image );
+        setg( begin, begin, begin + image_size );
+    }
+
+//------------------------------------------------------------------------------
+  protected:
+//------------------------------------------------------------------------------
+    pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+                      std::ios_base::openmode which = std::ios_base::in )
+    {
+        char* target;
+        if ( dir == std::ios_base::beg ) {
+            target = eback() + off;
+        }
+        else if ( dir == std::ios_base::cur ) {
+            target = gptr() + off;
+        }
+        else {
+            target = egptr() + off;
+        }
+
+        if ( !( which & std::ios_base::in ) ||
+             target < eback() || target > egptr() ) {
+            return pos_type( off_type( -1 ) );
+        }
+
+        setg( eback(), target, egptr() );
+        return pos_type( target - eback() );
+    }
+
+//------------------------------------------------------------------------------
+    pos_type seekpos( pos_type pos,
+                      std::ios_base::openmode which = std::ios_base::in )
+    {
+        return seekoff( off_type( pos ), std::ios_base::beg, which );
+    }
+};
+
 //------------------------------------------------------------------------------
 class elfio
 {
@@ -74,8 +120,10 @@ class elfio
 //------------------------------------------------------------------------------
     elfio() : sections( this ), segments( this )
     {
-        header           = 0;
-        current_file_pos = 0;
+        header             = 0;
+        current_file_pos   = 0;
+        pending_image      = 0;
+        pending_image_size = 0;
         create( ELFCLASS32, ELFDATA2LSB );
     }
 
@@ -109,42 +157,19 @@ class elfio
 //------------------------------------------------------------------------------
     bool load( std::istream &stream )
     {
-        clean();
-
-        unsigned char e_ident[EI_NIDENT];
-
-        // Read ELF file signature
-        stream.seekg( 0 );
-        stream.read( reinterpret_cast<char*>( &e_ident ), sizeof( e_ident ) );
-
-        // Is it ELF file?
-        if ( stream.gcount() != sizeof( e_ident ) ||
-             e_ident[EI_MAG0] != ELFMAG0    ||
-             e_ident[EI_MAG1] != ELFMAG1    ||
-             e_ident[EI_MAG2] != ELFMAG2    ||
-             e_ident[EI_MAG3] != ELFMAG3 ) {
-            return false;
-        }
-
-        if ( ( e_ident[EI_CLASS] != ELFCLASS64 ) &&
-             ( e_ident[EI_CLASS] != ELFCLASS32 )) {
-            return false;
-        }
-
-        convertor.setup( e_ident[EI_DATA] );
-
-        header = create_header( e_ident[EI_CLASS], e_ident[EI_DATA] );
-        if ( 0 == header ) {
-            return false;
-        }
-        if ( !header->load( stream ) ) {
-            return false;
-        }
+        return load_image( stream, 0, 0 );
+    }
 
-        load_sections( stream );
-        load_segments( stream );
+//------------------------------------------------------------------------------
+    // Load from an in-memory image such as a memory-mapped file. Section and
+    // segment data alias the image rather than being copied, so the image
+    // must outlive this object. Segments are only read once first accessed.
+    bool load( const char* image, Elf64_Off image_size )
+    {
+        image_streambuf buffer( image, image_size );
+        std::istream    stream( &buffer );
 
-        return true;
+        return load_image( stream, image, image_size );
     }
 
 //------------------------------------------------------------------------------
@@ -249,12 +274,79 @@ class elfio
 
 //------------------------------------------------------------------------------
   private:
+//------------------------------------------------------------------------------
+    bool load_image( std::istream &stream,
+                     const char* image, Elf64_Off image_size )
+    {
+        clean();
+
+        unsigned char e_ident[EI_NIDENT];
+
+        // Read ELF file signature
+        stream.seekg( 0 );
+        stream.read( reinterpret_cast<char*>( &e_ident ), sizeof( e_ident ) );
+
+        // Is it ELF file?
+        if ( stream.gcount() != sizeof( e_ident ) ||
+             e_ident[EI_MAG0] != ELFMAG0    ||
+             e_ident[EI_MAG1] != ELFMAG1    ||
+             e_ident[EI_MAG2] != ELFMAG2    ||
+             e_ident[EI_MAG3] != ELFMAG3 ) {
+            return false;
+        }
+
+        if ( ( e_ident[EI_CLASS] != ELFCLASS64 ) &&
+             ( e_ident[EI_CLASS] != ELFCLASS32 )) {
+            return false;
+        }
+
+        convertor.setup( e_ident[EI_DATA] );
+
+        header = create_header( e_ident[EI_CLASS], e_ident[EI_DATA] );
+        if ( 0 == header ) {
+            return false;
+        }
+        if ( !header->load( stream ) ) {
+            return false;
+        }
+
+        load_sections( stream, image, image_size );
+        if ( 0 != image ) {
+            // Most users never look at segments, defer them until needed
+            pending_image      = image;
+            pending_image_size = image_size;
+        }
+        else {
+            load_segments( stream, 0, 0 );
+        }
+
+        return true;
+    }
+
+//------------------------------------------------------------------------------
+    void load_pending_segments()
+    {
+        if ( 0 == pending_image ) {
+            return;
+        }
+
+        const char* image = pending_image;
+        pending_image     = 0;
+
+        image_streambuf buffer( image, pending_image_size );
+        std::istream    stream( &buffer );
+        load_segments( stream, image, pending_image_size );
+    }
+
 //------------------------------------------------------------------------------
     void clean()
     {
         delete header;
         header = 0;
 
+        pending_image      = 0;
+        pending_image_size = 0;
+
         std::vector<section*>::const_iterator it;
         for ( it = sections_.begin(); it != sections_.end(); ++it ) {
             delete *it;
@@ -350,7 +442,8 @@ class elfio
     }
 
 //------------------------------------------------------------------------------
-    Elf_Half load_sections( std::istream& stream )
+    Elf_Half load_sections( std::istream& stream,
+                            const char* image, Elf64_Off image_size )
     {
         Elf_Half  entry_size = header->get_section_entry_size();
         Elf_Half  num        = header->get_sections_num();
@@ -358,7 +451,12 @@ class elfio
 
         for ( Elf_Half i = 0; i < num; ++i ) {
             section* sec = create_section();
-            sec->load( stream, (std::streamoff)offset + i * entry_size );
+            if ( 0 != image ) {
+                sec->load( image, image_size, offset + i * entry_size );
+            }
+            else {
+                sec->load( stream, (std::streamoff)offset + i * entry_size );
+            }
             sec->set_index( i );
             // To mark that the section is not permitted to reassign address
             // during layout calculation
@@ -382,7 +480,8 @@ class elfio
     }
 
 //------------------------------------------------------------------------------
-    bool load_segments( std::istream& stream )
+    bool load_segments( std::istream& stream,
+                        const char* image, Elf64_Off image_size )
     {
         Elf_Half  entry_size = header->get_segment_entry_size();
         Elf_Half  num        = header->get_segments_num();
@@ -402,7 +501,12 @@ class elfio
                 return false;
             }
 
-            seg->load( stream, (std::streamoff)offset + i * entry_size );
+            if ( 0 != image ) {
+                seg->load( image, image_size, offset + i * entry_size );
+            }
+            else {
+                seg->load( stream, (std::streamoff)offset + i * entry_size );
+            }
             seg->set_index( i );
 
             // Add sections to the segments (similar to readelfs algorithm)
@@ -793,12 +897,14 @@ class elfio
 //------------------------------------------------------------------------------
         Elf_Half size() const
         {
+            parent->load_pending_segments();
             return (Elf_Half)parent->segments_.size();
         }
 
 //------------------------------------------------------------------------------
         segment* operator[]( unsigned int index ) const
         {
+            parent->load_pending_segments();
             return parent->segments_[index];
         }
 
@@ -806,16 +912,19 @@ class elfio
 //------------------------------------------------------------------------------
         segment* add()
         {
+            parent->load_pending_segments();
             return parent->create_segment();
         }
 
 //------------------------------------------------------------------------------
         std::vector<segment*>::iterator begin() {
+            parent->load_pending_segments();
             return parent->segments_.begin();
         }
 
 //------------------------------------------------------------------------------
         std::vector<segment*>::iterator end() {
+            parent->load_pending_segments();
             return parent->segments_.end();
         }
 
@@ -831,6 +940,10 @@ class elfio
     std::vector<segment*> segments_;
     endianess_convertor   convertor;
 
+    // Image segments are loaded from on first access, 0 once loaded
+    const char* pending_image;
+    Elf64_Off   pending_image_size;
+
     Elf_Xword current_file_pos;
 };
 
@@ -58,6 +58,9 @@ class section
     
     virtual void load( std::istream&  f,
                        std::streampos header_offset ) = 0;
+    virtual void load( const char*    image,
+                       Elf64_Off      image_size,
+                       Elf64_Off      header_offset ) = 0;
     virtual void save( std::ostream&  f,
                        std::streampos header_offset,
                        std::streampos data_offset )   = 0;
@@ -76,12 +79,13 @@ class section_impl : public section
         is_address_set = false;
         data           = 0;
         data_size      = 0;
+        is_data_borrowed = false;
     }
 
 //------------------------------------------------------------------------------
     ~section_impl()
     {
-        delete [] data;
+        release_data();
     }
 
 //------------------------------------------------------------------------------
@@ -146,7 +150,7 @@ class section_impl : public section
     set_data( const char* raw_data, Elf_Word size )
     {
         if ( get_type() != SHT_NOBITS ) {
-            delete [] data;
+            release_data();
             try {
                 data = new char[size];
             } catch (const std::bad_alloc&) {
@@ -190,7 +194,7 @@ class section_impl : public section
                 if ( 0 != new_data ) {
                     std::copy( data, data + get_size(), new_data );
                     std::copy( raw_data, raw_data + size, new_data + get_size() );
-                    delete [] data;
+                    release_data();
                     data = new_data;
                 }
             }
@@ -242,6 +246,31 @@ class section_impl : public section
         }
     }
 
+//------------------------------------------------------------------------------
+    void
+    load( const char* image,
+          Elf64_Off   image_size,
+          Elf64_Off   header_offset )
+    {
+        std::fill_n( reinterpret_cast<char*>( &header ), sizeof( header ), '\0' );
+        if ( header_offset + sizeof( header ) > image_size ) {
+            return;
+        }
+        std::copy( image + header_offset, image + header_offset + sizeof( header ),
+                   reinterpret_cast<char*>( &header ) );
+
+        // Alias the image instead of copying, so that section data which is
+        // never accessed is never read in either
+        Elf64_Off offset = (*convertor)( header.sh_offset );
+        Elf_Xword size   = get_size();
+        if ( 0 == data && SHT_NULL != get_type() && SHT_NOBITS != get_type() &&
+             offset <= image_size && size <= image_size - offset ) {
+            data             = const_cast<char*>( image + offset );
+            data_size        = (Elf_Word)size;
+            is_data_borrowed = true;
+        }
+    }
+
 //------------------------------------------------------------------------------
     void
     save( std::ostream&  f,
@@ -262,6 +291,17 @@ class section_impl : public section
 
 //------------------------------------------------------------------------------
   private:
+//------------------------------------------------------------------------------
+    void
+    release_data()
+    {
+        if ( !is_data_borrowed ) {
+            delete [] data;
+        }
+        data             = 0;
+        is_data_borrowed = false;
+    }
+
 //------------------------------------------------------------------------------
     void
     save_header( std::ostream&  f,
@@ -289,6 +329,7 @@ class section_impl : public section
     Elf_Word                   data_size;
     const endianess_convertor* convertor;
     bool                       is_address_set;
+    bool                       is_data_borrowed;
 };
 
 } // namespace ELFIO
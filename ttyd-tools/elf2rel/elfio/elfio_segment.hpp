@@ -57,6 +57,8 @@ class segment
     
     virtual const std::vector<Elf_Half>& get_sections() const               = 0;
     virtual void load( std::istream& stream, std::streampos header_offset ) = 0;
+    virtual void load( const char* image, Elf64_Off image_size,
+                       Elf64_Off header_offset )                           = 0;
     virtual void save( std::ostream& f,      std::streampos header_offset,
                                              std::streampos data_offset )   = 0;
 };
@@ -74,12 +76,15 @@ class segment_impl : public segment
         is_offset_set = false;
         std::fill_n( reinterpret_cast<char*>( &ph ), sizeof( ph ), '\0' );
         data = 0;
+        is_data_borrowed = false;
     }
 
 //------------------------------------------------------------------------------
     virtual ~segment_impl()
     {
-        delete [] data;
+        if ( !is_data_borrowed ) {
+            delete [] data;
+        }
     }
 
 //------------------------------------------------------------------------------
@@ -194,6 +199,29 @@ class segment_impl : public segment
         }
     }
 
+//------------------------------------------------------------------------------
+    void
+    load( const char* image,
+          Elf64_Off   image_size,
+          Elf64_Off   header_offset )
+    {
+        if ( header_offset + sizeof( ph ) > image_size ) {
+            return;
+        }
+        std::copy( image + header_offset, image + header_offset + sizeof( ph ),
+                   reinterpret_cast<char*>( &ph ) );
+        is_offset_set = true;
+
+        // Alias the image like sections do
+        Elf64_Off offset = (*convertor)( ph.p_offset );
+        Elf_Xword size   = get_file_size();
+        if ( PT_NULL != get_type() && 0 != size &&
+             offset <= image_size && size <= image_size - offset ) {
+            data             = const_cast<char*>( image + offset );
+            is_data_borrowed = true;
+        }
+    }
+
 //------------------------------------------------------------------------------
     void save( std::ostream&  f,
                std::streampos header_offset,
@@ -213,6 +241,7 @@ class segment_impl : public segment
     std::vector<Elf_Half> sections;
     endianess_convertor*  convertor;
     bool                  is_offset_set;
+    bool                  is_data_borrowed;
 };
 
 } // namespace ELFIO
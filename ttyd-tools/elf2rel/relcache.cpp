@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#include "relcache.h"
+
+#include <boost/filesystem.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+
+const uint32_t cEntryMagic = 0x5252554E; // 'RRUN'
+const uint32_t cEntryVersion = 3;
+const size_t cEntryHeaderSize = 2 * sizeof(uint32_t) + sizeof(uint64_t) + 3 * sizeof(uint32_t);
+const size_t cEntryRelocationSize = 14;
+
+}
+
+bool RelocationCache::open(const std::string &directory)
+{
+	boost::system::error_code error;
+	boost::filesystem::create_directories(directory, error);
+	if (error || !boost::filesystem::is_directory(directory, error))
+	{
+		return false;
+	}
+
+	mDirectory = directory;
+	return true;
+}
+
+bool RelocationCache::lookup(uint64_t key, Entry &entry) const
+{
+	std::ifstream inputStream(getEntryFilename(key), std::ios::binary);
+	if (!inputStream)
+	{
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+
+	// Anything that doesn't check out exactly is treated as a miss
+	if (data.size() < cEntryHeaderSize
+		|| readBigEndian<uint32_t>(&data[0]) != cEntryMagic
+		|| readBigEndian<uint32_t>(&data[4]) != cEntryVersion
+		|| readBigEndian<uint64_t>(&data[8]) != key)
+	{
+		return false;
+	}
+	size_t relocationCount = readBigEndian<uint32_t>(&data[16]);
+	size_t diagnosticsSize = readBigEndian<uint32_t>(&data[20]);
+	if (data.size() != cEntryHeaderSize + relocationCount * cEntryRelocationSize + diagnosticsSize)
+	{
+		return false;
+	}
+	entry.computeMicroseconds = readBigEndian<uint32_t>(&data[24]);
+
+	const uint8_t *cursor = &data[cEntryHeaderSize];
+	entry.relocations.resize(relocationCount);
+	for (auto &rel : entry.relocations)
+	{
+		rel.offset = readBigEndian<uint32_t>(cursor);
+		rel.addend = readBigEndian<uint32_t>(cursor + 4);
+		rel.section = readBigEndian<uint16_t>(cursor + 8);
+		rel.targetSection = readBigEndian<uint16_t>(cursor + 10);
+		rel.moduleSlot = cursor[12];
+		rel.type = cursor[13];
+		cursor += cEntryRelocationSize;
+	}
+	entry.diagnostics.assign(reinterpret_cast<const char *>(cursor), diagnosticsSize);
+
+	return true;
+}
+
+bool RelocationCache::store(uint64_t key, const Entry &entry) const
+{
+	std::vector<uint8_t> data(cEntryHeaderSize
+							  + entry.relocations.size() * cEntryRelocationSize
+							  + entry.diagnostics.size());
+	writeBigEndian<uint32_t>(&data[0], cEntryMagic);
+	writeBigEndian<uint32_t>(&data[4], cEntryVersion);
+	writeBigEndian<uint64_t>(&data[8], key);
+	writeBigEndian<uint32_t>(&data[16], static_cast<uint32_t>(entry.relocations.size()));
+	writeBigEndian<uint32_t>(&data[20], static_cast<uint32_t>(entry.diagnostics.size()));
+	writeBigEndian<uint32_t>(&data[24], entry.computeMicroseconds);
+
+	uint8_t *cursor = &data[cEntryHeaderSize];
+	for (const auto &rel : entry.relocations)
+	{
+		writeBigEndian<uint32_t>(cursor, rel.offset);
+		writeBigEndian<uint32_t>(cursor + 4, rel.addend);
+		writeBigEndian<uint16_t>(cursor + 8, rel.section);
+		writeBigEndian<uint16_t>(cursor + 10, rel.targetSection);
+		cursor[12] = rel.moduleSlot;
+		cursor[13] = rel.type;
+		cursor += cEntryRelocationSize;
+	}
+	std::copy(entry.diagnostics.begin(), entry.diagnostics.end(), cursor);
+
+	// Write to a randomly named temporary first so concurrent jobs producing the
+	// same entry, also from other processes sharing the cache directory, never
+	// observe each other's partial files
+	boost::system::error_code error;
+	boost::filesystem::path tempName = boost::filesystem::unique_path("%%%%%%%%%%%%%%%%", error);
+	if (error)
+	{
+		return false;
+	}
+	std::string filename = getEntryFilename(key);
+	std::string tempFilename = filename + "." + tempName.string() + ".tmp";
+	{
+		std::ofstream outputStream(tempFilename, std::ios::binary);
+		outputStream.write(reinterpret_cast<const char *>(data.data()), data.size());
+		if (!outputStream.good())
+		{
+			outputStream.close();
+			std::remove(tempFilename.c_str());
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(tempFilename, filename, error);
+	if (error)
+	{
+		std::remove(tempFilename.c_str());
+		return false;
+	}
+	return true;
+}
+
+std::string RelocationCache::getEntryFilename(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 ".rrun", key);
+	return (boost::filesystem::path(mDirectory) / name).string();
+}
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#pragma once
+
+#include "elf2rel.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk cache of resolved and sorted relocation runs. Every entry is keyed
+// by a hash of all inputs that went into it, so entries are never invalidated,
+// only superseded by entries under a new key.
+class RelocationCache
+{
+public:
+	struct Entry
+	{
+		std::vector<Relocation> relocations;
+		std::string diagnostics; // Serialized Diagnostics
+		// How long it took to compute the entry originally
+		uint32_t computeMicroseconds;
+	};
+
+	bool open(const std::string &directory);
+
+	bool lookup(uint64_t key, Entry &entry) const;
+	bool store(uint64_t key, const Entry &entry) const;
+
+	bool isOpen() const
+	{
+		return !mDirectory.empty();
+	}
+
+private:
+	std::string getEntryFilename(uint64_t key) const;
+
+private:
+	std::string mDirectory;
+};
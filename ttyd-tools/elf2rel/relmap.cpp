@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#include "relmap.h"
+
+#include "elf2rel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <tuple>
+
+namespace
+{
+
+const uint32_t cMapMagic = 0x524D4150; // 'RMAP'
+const uint32_t cMapVersion = 1;
+const size_t cMapHeaderSize = 6 * sizeof(uint32_t);
+const size_t cMapSymbolSize = 16;
+
+}
+
+RelSymbolMap::RelSymbolMap(uint32_t moduleID, uint32_t sectionCount)
+	: mModuleID(moduleID), mSectionCount(sectionCount)
+{
+}
+
+void RelSymbolMap::add(uint8_t section, uint32_t offset, uint32_t size, uint8_t type, const std::string &name)
+{
+	mSymbols.push_back({ offset, size, section, type, name });
+}
+
+void RelSymbolMap::finalize()
+{
+	// Larger symbols first at the same offset, so lookups find the enclosing one
+	std::sort(mSymbols.begin(), mSymbols.end(), [](const Symbol &left, const Symbol &right)
+	{
+		return std::tie(left.section, left.offset, right.size, left.name)
+			   < std::tie(right.section, right.offset, left.size, right.name);
+	});
+	mSymbols.erase(std::unique(mSymbols.begin(), mSymbols.end(), [](const Symbol &left, const Symbol &right)
+	{
+		return left.section == right.section && left.offset == right.offset && left.name == right.name;
+	}), mSymbols.end());
+}
+
+bool RelSymbolMap::saveText(const std::string &filename) const
+{
+	std::ofstream outputStream(filename);
+	char line[64];
+	snprintf(line, sizeof(line), "// Module %u, <section>:<offset> <size> <name>\n", mModuleID);
+	outputStream << line;
+	for (const auto &symbol : mSymbols)
+	{
+		snprintf(line, sizeof(line), "%02x:%08x %08x ", symbol.section, symbol.offset, symbol.size);
+		outputStream << line << symbol.name << "\n";
+	}
+	return outputStream.good();
+}
+
+bool RelSymbolMap::saveBinary(const std::string &filename) const
+{
+	size_t stringPoolSize = 0;
+	for (const auto &symbol : mSymbols)
+	{
+		stringPoolSize += symbol.name.size() + 1;
+	}
+	size_t sectionTableSize = (mSectionCount + 1) * sizeof(uint32_t);
+	std::vector<uint8_t> buffer(cMapHeaderSize
+								+ sectionTableSize
+								+ mSymbols.size() * cMapSymbolSize
+								+ stringPoolSize);
+
+	writeBigEndian<uint32_t>(&buffer[0], cMapMagic);
+	writeBigEndian<uint32_t>(&buffer[4], cMapVersion);
+	writeBigEndian<uint32_t>(&buffer[8], mModuleID);
+	writeBigEndian<uint32_t>(&buffer[12], mSectionCount);
+	writeBigEndian<uint32_t>(&buffer[16], static_cast<uint32_t>(mSymbols.size()));
+	writeBigEndian<uint32_t>(&buffer[20], static_cast<uint32_t>(stringPoolSize));
+
+	uint8_t *sectionCursor = &buffer[cMapHeaderSize];
+	size_t symbolIndex = 0;
+	for (uint32_t section = 0; section <= mSectionCount; ++section)
+	{
+		while (symbolIndex < mSymbols.size() && mSymbols[symbolIndex].section < section)
+		{
+			++symbolIndex;
+		}
+		writeBigEndian<uint32_t>(sectionCursor, static_cast<uint32_t>(symbolIndex));
+		sectionCursor += sizeof(uint32_t);
+	}
+
+	uint8_t *symbolCursor = sectionCursor;
+	uint8_t *stringPool = symbolCursor + mSymbols.size() * cMapSymbolSize;
+	uint32_t nameOffset = 0;
+	for (const auto &symbol : mSymbols)
+	{
+		writeBigEndian<uint32_t>(symbolCursor, symbol.offset);
+		writeBigEndian<uint32_t>(symbolCursor + 4, symbol.size);
+		writeBigEndian<uint32_t>(symbolCursor + 8, nameOffset);
+		symbolCursor[12] = symbol.section;
+		symbolCursor[13] = symbol.type;
+		symbolCursor += cMapSymbolSize;
+
+		std::copy(symbol.name.begin(), symbol.name.end(), stringPool + nameOffset);
+		nameOffset += static_cast<uint32_t>(symbol.name.size() + 1);
+	}
+
+	std::ofstream outputStream(filename, std::ios::binary);
+	outputStream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+	return outputStream.good();
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Symbols of a produced REL by section and section-relative offset, so a
+// loaded module can be symbolized from the section addresses OSLink assigned.
+//
+// The binary form is big-endian so the console can use it in place:
+//   header   'RMAP', version, module ID, section count, symbol count,
+//            string pool size
+//   u32      first symbol of every section, plus the symbol count at the end
+//   symbols  offset, size, name offset, section, ELF symbol type, 2 padding
+//   strings  zero-terminated names
+// Symbols are sorted by section and offset, so lookups are a binary search in
+// the range of one section.
+class RelSymbolMap
+{
+public:
+	struct Symbol
+	{
+		uint32_t offset;
+		uint32_t size;
+		uint8_t section;
+		uint8_t type;
+		std::string name;
+	};
+
+	RelSymbolMap(uint32_t moduleID, uint32_t sectionCount);
+
+	void add(uint8_t section, uint32_t offset, uint32_t size, uint8_t type, const std::string &name);
+
+	// Sorts the symbols and drops duplicates, call before saving
+	void finalize();
+
+	bool saveText(const std::string &filename) const;
+	bool saveBinary(const std::string &filename) const;
+
+	size_t size() const
+	{
+		return mSymbols.size();
+	}
+
+private:
+	uint32_t mModuleID;
+	uint32_t mSectionCount;
+	std::vector<Symbol> mSymbols;
+};
@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#include "symbolmap.h"
+
+#include "elf2rel.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+
+const uint32_t cDatabaseMagic = 0x53594D44; // 'SYMD'
+const uint32_t cDatabaseVersion = 1;
+const size_t cDatabaseHeaderSize = 5 * sizeof(uint32_t);
+const size_t cDatabaseEntrySize = 4 * sizeof(uint32_t);
+
+bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+int hexDigitValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+uint32_t parseHex(const char *begin, const char *end)
+{
+	if (end - begin >= 2 && begin[0] == '0' && (begin[1] == 'x' || begin[1] == 'X'))
+	{
+		begin += 2;
+	}
+
+	uint32_t value = 0;
+	for (; begin != end; ++begin)
+	{
+		int digit = hexDigitValue(*begin);
+		if (digit < 0)
+			break;
+		value = (value << 4) | digit;
+	}
+	return value;
+}
+
+}
+
+bool SymbolMap::loadFile(const std::string &filename)
+{
+	namespace bip = boost::interprocess;
+
+	bip::file_mapping mapping;
+	bip::mapped_region region;
+	const uint8_t *data;
+	size_t size;
+	std::vector<uint8_t> fallbackData;
+	try
+	{
+		mapping = bip::file_mapping(filename.c_str(), bip::read_only);
+		region = bip::mapped_region(mapping, bip::read_only);
+		data = static_cast<const uint8_t *>(region.get_address());
+		size = region.get_size();
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		// Mapping fails for empty files among others, just read it normally
+		std::ifstream inputStream(filename, std::ios::binary);
+		if (!inputStream)
+		{
+			return false;
+		}
+		fallbackData.assign(std::istreambuf_iterator<char>(inputStream), std::istreambuf_iterator<char>());
+		data = fallbackData.data();
+		size = fallbackData.size();
+	}
+
+	if (size >= sizeof(uint32_t) && readBigEndian<uint32_t>(data) == cDatabaseMagic)
+	{
+		return loadDatabase(data, size);
+	}
+	return loadText(reinterpret_cast<const char *>(data), size);
+}
+
+bool SymbolMap::loadText(const char *data, size_t size)
+{
+	struct PendingEntry
+	{
+		const char *name;
+		uint32_t nameLength;
+		uint32_t address;
+	};
+	std::vector<PendingEntry> pending;
+
+	const char *end = data + size;
+	for (const char *line = data; line < end; )
+	{
+		const char *lineEnd = static_cast<const char *>(memchr(line, '\n', end - line));
+		if (!lineEnd)
+		{
+			lineEnd = end;
+		}
+		const char *next = lineEnd < end ? lineEnd + 1 : end;
+
+		// Trim whitespace, including the CR of CRLF line endings
+		while (line < lineEnd && isSpace(*line))
+			++line;
+		while (lineEnd > line && isSpace(lineEnd[-1]))
+			--lineEnd;
+
+		// Ignore comments and lines without an address
+		const char *colon = static_cast<const char *>(memchr(line, ':', lineEnd - line));
+		if (line == lineEnd || *line == '/' || !colon)
+		{
+			line = next;
+			continue;
+		}
+
+		const char *name = colon + 1;
+		while (name < lineEnd && isSpace(*name))
+			++name;
+
+		if (name != lineEnd)
+		{
+			PendingEntry entry;
+			entry.name = name;
+			entry.nameLength = static_cast<uint32_t>(lineEnd - name);
+			entry.address = parseHex(line, colon);
+			pending.emplace_back(entry);
+		}
+
+		line = next;
+	}
+
+	// Sort by name, later definitions of a name replace earlier ones
+	std::stable_sort(pending.begin(), pending.end(),
+					 [](const PendingEntry &left, const PendingEntry &right)
+	{
+		int result = memcmp(left.name, right.name, std::min(left.nameLength, right.nameLength));
+		return result != 0 ? result < 0 : left.nameLength < right.nameLength;
+	});
+
+	mStringPool.clear();
+	mEntries.clear();
+	mEntries.reserve(pending.size());
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		const PendingEntry &entry = pending[i];
+		if (i + 1 < pending.size()
+			&& pending[i + 1].nameLength == entry.nameLength
+			&& memcmp(pending[i + 1].name, entry.name, entry.nameLength) == 0)
+		{
+			continue;
+		}
+
+		Entry outEntry;
+		outEntry.nameOffset = static_cast<uint32_t>(mStringPool.size());
+		outEntry.nameLength = entry.nameLength;
+		outEntry.hash = hashString(entry.name, entry.name + entry.nameLength);
+		outEntry.address = entry.address;
+		mEntries.emplace_back(outEntry);
+
+		mStringPool.insert(mStringPool.end(), entry.name, entry.name + entry.nameLength);
+		mStringPool.emplace_back('\0');
+	}
+
+	buildHashTable();
+	computeDigest();
+	return true;
+}
+
+bool SymbolMap::loadDatabase(const uint8_t *data, size_t size)
+{
+	if (size < cDatabaseHeaderSize
+		|| readBigEndian<uint32_t>(data) != cDatabaseMagic
+		|| readBigEndian<uint32_t>(data + 4) != cDatabaseVersion)
+	{
+		return false;
+	}
+
+	size_t entryCount = readBigEndian<uint32_t>(data + 8);
+	size_t hashTableSize = readBigEndian<uint32_t>(data + 12);
+	size_t stringPoolSize = readBigEndian<uint32_t>(data + 16);
+	if (size != cDatabaseHeaderSize
+				+ entryCount * cDatabaseEntrySize
+				+ hashTableSize * sizeof(uint32_t)
+				+ stringPoolSize
+		|| (hashTableSize & (hashTableSize - 1)) != 0
+		|| hashTableSize <= entryCount)
+	{
+		return false;
+	}
+
+	const uint8_t *entryData = data + cDatabaseHeaderSize;
+	mEntries.resize(entryCount);
+	for (size_t i = 0; i < entryCount; ++i)
+	{
+		const uint8_t *entry = entryData + i * cDatabaseEntrySize;
+		mEntries[i].nameOffset = readBigEndian<uint32_t>(entry);
+		mEntries[i].nameLength = readBigEndian<uint32_t>(entry + 4);
+		mEntries[i].hash = readBigEndian<uint32_t>(entry + 8);
+		mEntries[i].address = readBigEndian<uint32_t>(entry + 12);
+		if (static_cast<size_t>(mEntries[i].nameOffset) + mEntries[i].nameLength >= stringPoolSize)
+		{
+			return false;
+		}
+	}
+
+	const uint8_t *hashTableData = entryData + entryCount * cDatabaseEntrySize;
+	mHashTable.resize(hashTableSize);
+	for (size_t i = 0; i < hashTableSize; ++i)
+	{
+		mHashTable[i] = readBigEndian<uint32_t>(hashTableData + i * sizeof(uint32_t));
+		if (mHashTable[i] > entryCount)
+		{
+			return false;
+		}
+	}
+
+	const char *stringPoolData = reinterpret_cast<const char *>(hashTableData + hashTableSize * sizeof(uint32_t));
+	mStringPool.assign(stringPoolData, stringPoolData + stringPoolSize);
+
+	computeDigest();
+	return true;
+}
+
+bool SymbolMap::saveDatabase(const std::string &filename) const
+{
+	std::vector<uint8_t> buffer(cDatabaseHeaderSize
+								+ mEntries.size() * cDatabaseEntrySize
+								+ mHashTable.size() * sizeof(uint32_t)
+								+ mStringPool.size());
+
+	writeBigEndian<uint32_t>(&buffer[0], cDatabaseMagic);
+	writeBigEndian<uint32_t>(&buffer[4], cDatabaseVersion);
+	writeBigEndian<uint32_t>(&buffer[8], static_cast<uint32_t>(mEntries.size()));
+	writeBigEndian<uint32_t>(&buffer[12], static_cast<uint32_t>(mHashTable.size()));
+	writeBigEndian<uint32_t>(&buffer[16], static_cast<uint32_t>(mStringPool.size()));
+
+	uint8_t *cursor = &buffer[cDatabaseHeaderSize];
+	for (const auto &entry : mEntries)
+	{
+		writeBigEndian<uint32_t>(cursor, entry.nameOffset);
+		writeBigEndian<uint32_t>(cursor + 4, entry.nameLength);
+		writeBigEndian<uint32_t>(cursor + 8, entry.hash);
+		writeBigEndian<uint32_t>(cursor + 12, entry.address);
+		cursor += cDatabaseEntrySize;
+	}
+	for (uint32_t slot : mHashTable)
+	{
+		writeBigEndian<uint32_t>(cursor, slot);
+		cursor += sizeof(uint32_t);
+	}
+	std::copy(mStringPool.begin(), mStringPool.end(), cursor);
+
+	std::ofstream outputStream(filename, std::ios::binary);
+	outputStream.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+	return outputStream.good();
+}
+
+bool SymbolMap::find(const char *name, uint32_t &address) const
+{
+	if (mHashTable.empty())
+	{
+		return false;
+	}
+
+	size_t length = strlen(name);
+	uint32_t hash = hashString(name, name + length);
+	size_t mask = mHashTable.size() - 1;
+	for (size_t slot = hash & mask; mHashTable[slot] != 0; slot = (slot + 1) & mask)
+	{
+		const Entry &entry = mEntries[mHashTable[slot] - 1];
+		if (entry.hash == hash
+			&& entry.nameLength == length
+			&& memcmp(&mStringPool[entry.nameOffset], name, length) == 0)
+		{
+			address = entry.address;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<std::string> SymbolMap::findSimilar(const char *name, size_t maxCount) const
+{
+	size_t length = strlen(name);
+	// Allow a typo or two, and a few more for long (usually mangled) names
+	size_t maxDistance = std::max<size_t>(2, length / 8);
+
+	std::vector<std::pair<size_t, uint32_t>> matches;
+	std::vector<size_t> transposeRow(length + 1);
+	std::vector<size_t> previousRow(length + 1);
+	std::vector<size_t> currentRow(length + 1);
+	for (uint32_t i = 0; i < mEntries.size(); ++i)
+	{
+		const Entry &entry = mEntries[i];
+		size_t entryLength = entry.nameLength;
+		if (std::max(entryLength, length) - std::min(entryLength, length) > maxDistance)
+		{
+			continue;
+		}
+
+		// Edit distance counting swapped neighbours as one edit, giving up once
+		// every path is too long
+		const char *entryName = &mStringPool[entry.nameOffset];
+		for (size_t j = 0; j <= length; ++j)
+		{
+			previousRow[j] = j;
+		}
+		bool tooFar = false;
+		for (size_t k = 1; k <= entryLength && !tooFar; ++k)
+		{
+			currentRow[0] = k;
+			size_t rowMinimum = k;
+			for (size_t j = 1; j <= length; ++j)
+			{
+				size_t substitution = previousRow[j - 1] + (entryName[k - 1] != name[j - 1]);
+				currentRow[j] = std::min(std::min(previousRow[j], currentRow[j - 1]) + 1, substitution);
+				if (k > 1 && j > 1 && entryName[k - 1] == name[j - 2] && entryName[k - 2] == name[j - 1])
+				{
+					currentRow[j] = std::min(currentRow[j], transposeRow[j - 2] + 1);
+				}
+				rowMinimum = std::min(rowMinimum, currentRow[j]);
+			}
+			tooFar = rowMinimum > maxDistance;
+			transposeRow.swap(previousRow);
+			previousRow.swap(currentRow);
+		}
+		if (!tooFar && previousRow[length] <= maxDistance)
+		{
+			matches.emplace_back(previousRow[length], i);
+		}
+	}
+
+	std::sort(matches.begin(), matches.end());
+	std::vector<std::string> names;
+	for (size_t i = 0; i < matches.size() && i < maxCount; ++i)
+	{
+		const Entry &entry = mEntries[matches[i].second];
+		names.emplace_back(&mStringPool[entry.nameOffset], entry.nameLength);
+	}
+	return names;
+}
+
+void SymbolMap::buildHashTable()
+{
+	// Keep the load factor at or below one half
+	size_t tableSize = 16;
+	while (tableSize < mEntries.size() * 2)
+	{
+		tableSize *= 2;
+	}
+
+	mHashTable.assign(tableSize, 0);
+	size_t mask = tableSize - 1;
+	for (size_t i = 0; i < mEntries.size(); ++i)
+	{
+		size_t slot = mEntries[i].hash & mask;
+		while (mHashTable[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		mHashTable[slot] = static_cast<uint32_t>(i + 1);
+	}
+}
+
+void SymbolMap::computeDigest()
+{
+	uint64_t digest = hashBytes(mStringPool.data(), mStringPool.size());
+	for (const auto &entry : mEntries)
+	{
+		digest = hashBytes(&entry.nameOffset, sizeof(entry.nameOffset), digest);
+		digest = hashBytes(&entry.address, sizeof(entry.address), digest);
+	}
+	mDigest = digest;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only map from external symbol name to address. Names are kept sorted
+// in a single string pool and looked up through an open-addressing hash table.
+class SymbolMap
+{
+public:
+	// Loads either a text symbol file (address:name per line) or a symbol
+	// database previously written by saveDatabase
+	bool loadFile(const std::string &filename);
+	bool loadText(const char *data, size_t size);
+	bool loadDatabase(const uint8_t *data, size_t size);
+
+	bool saveDatabase(const std::string &filename) const;
+
+	bool find(const char *name, uint32_t &address) const;
+
+	// Names within a small edit distance of the given one, closest first.
+	// Only meant for error messages, this looks at every entry.
+	std::vector<std::string> findSimilar(const char *name, size_t maxCount) const;
+
+	size_t size() const
+	{
+		return mEntries.size();
+	}
+
+	// Hash of all names and addresses, changes whenever lookups could
+	uint64_t getDigest() const
+	{
+		return mDigest;
+	}
+
+private:
+	struct Entry
+	{
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint32_t hash;
+		uint32_t address;
+	};
+
+	void buildHashTable();
+	void computeDigest();
+
+private:
+	std::vector<char> mStringPool;
+	std::vector<Entry> mEntries;
+	// Entry index + 1 per slot, 0 is empty. Size is always a power of two.
+	std::vector<uint32_t> mHashTable;
+	uint64_t mDigest = 0;
+};
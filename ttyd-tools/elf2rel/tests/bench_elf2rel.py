@@ -0,0 +1,120 @@
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# Times elf2rel on a synthetic ELF. With --baseline, the same input is also
+# converted by another build (e.g. one from before a change) and both RELs
+# have to match byte for byte. Options this script doesn't know are passed on
+# to elf2rel.
+#
+# --relocation-heavy switches to a small symbol table with millions of
+# relocations, so the time goes into collecting, sorting and applying
+# relocations rather than symbol lookup, and reports relocations per second.
+#
+# The input carries 32 MB of DWARF by default, which elf2rel never emits and
+# shouldn't have to read, so peak memory shows whether it does. Peak RSS is
+# taken from each run on its own and needs os.wait4 (Linux, macOS). Linux
+# counts what the forked benchmark process had mapped before exec too, so the
+# input is generated by a separate process to keep that small.
+
+def run_conversion(command):
+	# Returns (exit code, seconds, peak RSS in bytes or None, stderr)
+	with tempfile.TemporaryFile() as error_file:
+		start = time.perf_counter()
+		process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=error_file)
+		if hasattr(os, "wait4"):
+			_, status, usage = os.wait4(process.pid, 0)
+			seconds = time.perf_counter() - start
+			process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+			# Kilobytes on Linux, bytes on macOS
+			peak_rss = usage.ru_maxrss if sys.platform == "darwin" else usage.ru_maxrss * 1024
+		else:
+			process.wait()
+			seconds = time.perf_counter() - start
+			peak_rss = None
+		error_file.seek(0)
+		return process.returncode, seconds, peak_rss, error_file.read()
+
+def time_conversion(executable, elf_filename, symbol_filename, output_filename, runs, extra_args):
+	command = [executable, "-i", elf_filename, "-s", symbol_filename, "-o", output_filename] + extra_args
+	times = []
+	peak_rss = []
+	for _ in range(runs):
+		returncode, seconds, run_peak_rss, errors = run_conversion(command)
+		if returncode != 0:
+			sys.stderr.write(errors.decode(errors="replace"))
+			raise RuntimeError("{} failed with exit code {}".format(executable, returncode))
+		times.append(seconds)
+		if run_peak_rss is not None:
+			peak_rss.append(run_peak_rss)
+	return times, peak_rss
+
+def print_times(name, times, peak_rss, relocation_count):
+	print("{:<10} best {:8.3f}s  median {:8.3f}s  {:8.2f}M relocations/s  peak RSS {}".format(
+		name, min(times), statistics.median(times), relocation_count / min(times) / 1e6,
+		"{:.1f} MB".format(max(peak_rss) / (1 << 20)) if peak_rss else "n/a"))
+
+def main():
+	parser = argparse.ArgumentParser(description="Benchmark elf2rel on a synthetic ELF")
+	parser.add_argument("elf2rel", help="elf2rel executable to time")
+	parser.add_argument("--baseline", help="Another elf2rel executable to compare against")
+	parser.add_argument("--symbol-count", type=int)
+	parser.add_argument("--relocation-count", type=int)
+	parser.add_argument("--relocation-heavy", action="store_true", help="Default to 2000 symbols and 2M relocations")
+	parser.add_argument("--debug-size", type=int, default=32 << 20, help="Bytes of .debug_info in the input")
+	parser.add_argument("--runs", type=int, default=5)
+	parser.add_argument("--seed", type=int, default=1)
+	parser.add_argument("--work-dir", help="Keep the generated files here instead of a temporary directory")
+	args, extra_args = parser.parse_known_args()
+	extra_args = [arg for arg in extra_args if arg != "--"]
+
+	if args.relocation_heavy:
+		symbol_count, relocation_count = 2000, 2000000
+	else:
+		symbol_count, relocation_count = 100000, 500000
+	if args.symbol_count is not None:
+		symbol_count = args.symbol_count
+	if args.relocation_count is not None:
+		relocation_count = args.relocation_count
+
+	with tempfile.TemporaryDirectory() as temp_dir:
+		work_dir = args.work_dir or temp_dir
+		os.makedirs(work_dir, exist_ok=True)
+		elf_filename = os.path.join(work_dir, "bench.elf")
+		symbol_filename = os.path.join(work_dir, "bench.lst")
+
+		print("Generating {} symbols, {} relocations, {:.1f} MB of debug info".format(
+			symbol_count, relocation_count, args.debug_size / (1 << 20)))
+		generator = os.path.join(os.path.dirname(os.path.abspath(__file__)), "make_test_elf.py")
+		subprocess.run([
+			sys.executable, generator, elf_filename, symbol_filename,
+			"--symbol-count", str(symbol_count),
+			"--relocation-count", str(relocation_count),
+			"--debug-size", str(args.debug_size),
+			"--seed", str(args.seed)], check=True)
+
+		output_filename = os.path.join(work_dir, "bench.rel")
+		times, peak_rss = time_conversion(args.elf2rel, elf_filename, symbol_filename, output_filename, args.runs, extra_args)
+		print_times("elf2rel", times, peak_rss, relocation_count)
+
+		if args.baseline:
+			baseline_filename = os.path.join(work_dir, "bench.baseline.rel")
+			baseline_times, baseline_peak_rss = time_conversion(
+				args.baseline, elf_filename, symbol_filename, baseline_filename, args.runs, extra_args)
+			print_times("baseline", baseline_times, baseline_peak_rss, relocation_count)
+			print("Speedup    {:.2f}x".format(min(baseline_times) / min(times)))
+			if peak_rss and baseline_peak_rss:
+				print("Peak RSS   {:.2f}x of baseline".format(max(peak_rss) / max(baseline_peak_rss)))
+
+			with open(output_filename, "rb") as output_file, open(baseline_filename, "rb") as baseline_file:
+				if output_file.read() != baseline_file.read():
+					print("Output differs from baseline")
+					return 1
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,90 @@
+import argparse
+import os
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+# Links a large REL to a fixed address with both rellink/rellink.py and
+# elf2rel --link-rel, reports how long each takes and checks that both produce
+# the same image. rellink.py always puts BSS at 0x81000000 and appends a NUL to
+# its output, elf2rel is given the same BSS address and the NUL is ignored.
+# Exits with 1 if the images differ.
+
+RELLINK_BSS_ADDRESS = "0x81000000"
+
+def run(command, runs):
+	times = []
+	for _ in range(runs):
+		start = time.perf_counter()
+		result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+		times.append(time.perf_counter() - start)
+		if result.returncode != 0:
+			sys.stderr.write(result.stderr.decode(errors="replace"))
+			raise RuntimeError("{} failed with exit code {}".format(" ".join(command), result.returncode))
+	return times
+
+def print_times(name, times, entry_count):
+	print("{:<10} best {:8.3f}s  median {:8.3f}s  {:8.2f}M relocation entries/s".format(
+		name, min(times), statistics.median(times), entry_count / min(times) / 1e6))
+
+def main():
+	tests_dir = os.path.dirname(os.path.abspath(__file__))
+	parser = argparse.ArgumentParser(description="Compare elf2rel --link-rel against rellink.py")
+	parser.add_argument("elf2rel", help="elf2rel executable")
+	parser.add_argument("--rellink", default=os.path.join(tests_dir, "..", "..", "rellink", "rellink.py"))
+	parser.add_argument("--symbol-count", type=int, default=100000)
+	parser.add_argument("--relocation-count", type=int, default=500000)
+	parser.add_argument("--load-address", default="0x80600000")
+	parser.add_argument("--runs", type=int, default=3)
+	parser.add_argument("--seed", type=int, default=1)
+	parser.add_argument("--work-dir", help="Keep the generated files here instead of a temporary directory")
+	args = parser.parse_args()
+
+	with tempfile.TemporaryDirectory() as temp_dir:
+		work_dir = args.work_dir or temp_dir
+		os.makedirs(work_dir, exist_ok=True)
+		elf_filename = os.path.join(work_dir, "link.elf")
+		symbol_filename = os.path.join(work_dir, "link.lst")
+		rel_filename = os.path.join(work_dir, "link.rel")
+
+		print("Generating {} symbols, {} relocations".format(args.symbol_count, args.relocation_count))
+		subprocess.run([
+			sys.executable, os.path.join(tests_dir, "make_test_elf.py"), elf_filename, symbol_filename,
+			"--symbol-count", str(args.symbol_count),
+			"--relocation-count", str(args.relocation_count),
+			"--seed", str(args.seed)], check=True)
+		run([args.elf2rel, "-i", elf_filename, "-s", symbol_filename, "-o", rel_filename], 1)
+
+		with open(rel_filename, "rb") as rel_file:
+			rel = rel_file.read()
+		relocation_offset = struct.unpack_from(">I", rel, 0x24)[0]
+		entry_count = (len(rel) - relocation_offset) // 8
+		print("REL size {:.1f} MB, {} relocation entries".format(len(rel) / (1 << 20), entry_count))
+
+		native_filename = os.path.join(work_dir, "link.native.rel")
+		native_times = run([
+			args.elf2rel, "--link-rel", rel_filename, "-o", native_filename,
+			"--load-address", args.load_address, "--bss-address", RELLINK_BSS_ADDRESS], args.runs)
+		print_times("elf2rel", native_times, entry_count)
+
+		# rellink.py writes next to its input
+		rellink_times = run([sys.executable, args.rellink, rel_filename, args.load_address], args.runs)
+		print_times("rellink.py", rellink_times, entry_count)
+		print("Speedup    {:.2f}x".format(min(rellink_times) / min(native_times)))
+
+		with open(native_filename, "rb") as native_file, open(rel_filename + ".linked", "rb") as rellink_file:
+			native = native_file.read()
+			linked = rellink_file.read()
+		if linked[-1:] == b"\0":
+			linked = linked[:-1]
+		if native != linked:
+			print("Linked images differ")
+			return 1
+		print("Linked images match")
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,79 @@
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+import make_test_elf
+
+# Converts a synthetic ELF with -j 1 and with more worker threads and checks
+# that every REL is identical. The code is split over many sections, so the
+# relocation sections really are collected by different threads and merged.
+# A second ELF has more sections than a REL can address, as -ffunction-sections
+# builds do, and is only converted with --merge-sections. Exits with 1 if any
+# output differs or a conversion fails.
+
+OPTION_SETS = [
+	[],
+	["--optimize-relocations"],
+	["--load-address", "0x80600000"],
+	["--rel-version", "1"],
+]
+
+MANY_TEXT_SECTIONS = 300
+MANY_SECTIONS_OPTION_SETS = [
+	["--merge-sections"],
+	["--merge-sections", "--optimize-relocations"],
+]
+
+def convert(executable, elf_filename, symbol_filename, output_filename, args):
+	command = [executable, "-i", elf_filename, "-s", symbol_filename, "-o", output_filename] + args
+	result = subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+	if result.returncode != 0:
+		sys.stderr.write(result.stderr.decode(errors="replace"))
+		raise RuntimeError("{} failed with exit code {}".format(" ".join(command), result.returncode))
+	with open(output_filename, "rb") as output_file:
+		return output_file.read()
+
+def main():
+	parser = argparse.ArgumentParser(description="Check that elf2rel output does not depend on the thread count")
+	parser.add_argument("elf2rel", help="elf2rel executable to check")
+	parser.add_argument("--jobs", type=int, nargs="+", default=[2, 3, 8], help="Thread counts to compare against -j 1")
+	parser.add_argument("--symbol-count", type=int, default=20000)
+	parser.add_argument("--relocation-count", type=int, default=200000)
+	parser.add_argument("--text-sections", type=int, default=16)
+	parser.add_argument("--seed", type=int, default=1)
+	args = parser.parse_args()
+
+	inputs = [
+		(args.text_sections, OPTION_SETS),
+		(MANY_TEXT_SECTIONS, MANY_SECTIONS_OPTION_SETS),
+	]
+
+	failures = 0
+	with tempfile.TemporaryDirectory() as work_dir:
+		for text_section_count, option_sets in inputs:
+			elf_filename = os.path.join(work_dir, "test.elf")
+			symbol_filename = os.path.join(work_dir, "test.lst")
+			make_test_elf.generate(
+				elf_filename, symbol_filename, args.symbol_count, args.relocation_count,
+				args.seed, text_section_count=text_section_count)
+
+			print("{} code sections".format(text_section_count))
+			for options in option_sets:
+				output_filename = os.path.join(work_dir, "test.rel")
+				reference = convert(args.elf2rel, elf_filename, symbol_filename, output_filename, options + ["-j", "1"])
+				for jobs in args.jobs:
+					output = convert(args.elf2rel, elf_filename, symbol_filename, output_filename, options + ["-j", str(jobs)])
+					matches = output == reference
+					if not matches:
+						failures += 1
+					print("{:<40} -j {:<3} {}".format(" ".join(options) or "(default)", jobs, "ok" if matches else "DIFFERS"))
+
+	if failures:
+		print("{} conversions differ from -j 1".format(failures))
+		return 1
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,228 @@
+import argparse
+import random
+import struct
+
+# Writes a synthetic relocatable PowerPC ELF together with a symbol file for
+# elf2rel. Half of the symbols are module locals spread over the usual
+# sections, the other half are game symbols listed in the symbol file. The
+# relocations are a mix of the types compilers emit, against both kinds.
+
+SHT_NULL = 0
+SHT_PROGBITS = 1
+SHT_SYMTAB = 2
+SHT_STRTAB = 3
+SHT_RELA = 4
+SHT_NOBITS = 8
+
+SHF_WRITE = 1
+SHF_ALLOC = 2
+SHF_EXECINSTR = 4
+
+STB_LOCAL = 0
+STB_GLOBAL = 1
+STT_NOTYPE = 0
+STT_OBJECT = 1
+STT_FUNC = 2
+STT_SECTION = 3
+
+R_PPC_ADDR32 = 1
+R_PPC_ADDR16_LO = 4
+R_PPC_ADDR16_HA = 6
+R_PPC_REL24 = 10
+
+GAME_SYMBOL_BASE = 0x80004000
+
+class Section:
+	def __init__(self, name, type, flags, align, data=b"", size=0, entsize=0):
+		self.name = name
+		self.type = type
+		self.flags = flags
+		self.align = align
+		self.data = data
+		self.size = size
+		self.link = 0
+		self.info = 0
+		self.entsize = entsize
+
+def pack_rela(offset, symbol, type, addend):
+	return struct.pack(">IIi", offset, (symbol << 8) | type, addend)
+
+def generate(elf_filename, symbol_filename, symbol_count, relocation_count, seed=1, debug_size=0, text_section_count=1):
+	rng = random.Random(seed)
+
+	# Leave the first words of .text for the fixed relocations below
+	text_size = max(0x30000, (relocation_count + 32) * 8)
+	# The generated code can be split over several sections, each with its own
+	# relocation section
+	words_per_text_section = text_size // 4 // text_section_count
+
+	sections = [Section("", SHT_NULL, 0, 0)]
+	def add_section(section):
+		sections.append(section)
+		return len(sections) - 1
+	def add_rela(target):
+		index = add_section(Section(".rela" + sections[target].name, SHT_RELA, 0, 4, entsize=12))
+		sections[index].info = target
+		return index
+
+	text_sections = []
+	rela_text_sections = []
+	for i in range(text_section_count):
+		name = ".text.part{}".format(i) if i else ".text"
+		text_sections.append(add_section(Section(name, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4, b"\x48\x00\x00\x01" * words_per_text_section)))
+		rela_text_sections.append(add_rela(text_sections[-1]))
+	text = text_sections[0]
+	text_func = add_section(Section(".text.func", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16, b"\x60\x00\x00\x00" * 64))
+	rela_text_func = add_rela(text_func)
+	data = add_section(Section(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8, bytes(range(256)) * 64))
+	rela_data = add_rela(data)
+	rodata = add_section(Section(".rodata.str", SHT_PROGBITS, SHF_ALLOC, 32, b"hello world\0" * 33))
+	ctors = add_section(Section(".ctors", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 4, bytes(8)))
+	rela_ctors = add_rela(ctors)
+	bss = add_section(Section(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 32, size=0x1234))
+	rela_sections = rela_text_sections + [rela_text_func, rela_data, rela_ctors]
+	if debug_size:
+		debug_info = add_section(Section(".debug_info", SHT_PROGBITS, 0, 1, bytes(debug_size)))
+		rela_sections.append(add_rela(debug_info))
+	add_section(Section(".comment", SHT_PROGBITS, 0, 1, b"GCC\0"))
+	symtab = add_section(Section(".symtab", SHT_SYMTAB, 0, 4, entsize=16))
+	strtab = add_section(Section(".strtab", SHT_STRTAB, 0, 1))
+	shstrtab = add_section(Section(".shstrtab", SHT_STRTAB, 0, 1))
+	for index in rela_sections:
+		sections[index].link = symtab
+	sections[symtab].link = strtab
+
+	# Symbols, locals first as the ELF spec requires
+	strings = bytearray(b"\0")
+	symbols = [(0, 0, 0, 0, 0, 0)]
+	def add_symbol(name, value, size, bind, type, section_index):
+		name_offset = 0
+		if name:
+			name_offset = len(strings)
+			strings.extend(name.encode() + b"\0")
+		symbols.append((name_offset, value, size, (bind << 4) | type, 0, section_index))
+		return len(symbols) - 1
+
+	for index in (text, text_func, data, rodata, ctors, bss):
+		add_symbol("", 0, 0, STB_LOCAL, STT_SECTION, index)
+	data_symbol = symbols.index((0, 0, 0, STT_SECTION, 0, data))
+
+	local_symbols = []
+	text_symbols = []
+	for i in range(symbol_count // 2):
+		section_index = rng.choice([text, data, bss, rodata])
+		symbol = add_symbol("local_{}".format(i), rng.randrange(0, 0x100) * 4, 4, STB_LOCAL, STT_OBJECT, section_index)
+		local_symbols.append(symbol)
+		if section_index == text:
+			text_symbols.append(symbol)
+
+	sections[symtab].info = len(symbols)
+	prolog = add_symbol("_prolog", 0x100, 4, STB_GLOBAL, STT_FUNC, text)
+	epilog = add_symbol("_epilog", 0x10, 4, STB_GLOBAL, STT_FUNC, text_func)
+	add_symbol("_unresolved", 0x200, 4, STB_GLOBAL, STT_FUNC, text)
+
+	symbol_lines = ["// Synthetic symbol map", ""]
+	game_symbols = []
+	for i in range(max(symbol_count // 2, 1)):
+		name = "gameFunction_{}".format(i)
+		game_symbols.append(add_symbol(name, 0, 0, STB_GLOBAL, STT_NOTYPE, 0))
+		symbol_lines.append("{:08X}:{}".format(GAME_SYMBOL_BASE + i * 4, name))
+
+	local_symbols = local_symbols or [prolog]
+	text_symbols = text_symbols[:50] or [prolog]
+
+	# Relocations
+	rela_text_data = [bytearray() for _ in text_sections]
+	offsets = rng.sample(range(32, words_per_text_section * text_section_count), relocation_count)
+	for word in offsets:
+		part = word // words_per_text_section
+		offset = word % words_per_text_section * 4
+		kind = rng.randrange(6)
+		if kind == 0:
+			rela_text_data[part] += pack_rela(offset, rng.choice(game_symbols), R_PPC_REL24, 0)
+		elif kind == 1:
+			rela_text_data[part] += pack_rela(offset, rng.choice(text_symbols), R_PPC_REL24, 0)
+		elif kind == 2:
+			rela_text_data[part] += pack_rela(offset + 2, rng.choice(game_symbols), R_PPC_ADDR16_HA, rng.randrange(16))
+		elif kind == 3:
+			rela_text_data[part] += pack_rela(offset + 2, rng.choice(local_symbols), R_PPC_ADDR16_LO, 4)
+		elif kind == 4:
+			rela_text_data[part] += pack_rela(offset, prolog, R_PPC_REL24, 8)
+		else:
+			rela_text_data[part] += pack_rela(offset, rng.choice(game_symbols), R_PPC_ADDR32, 0)
+	for index, relocations in zip(rela_text_sections, rela_text_data):
+		sections[index].data = bytes(relocations)
+
+	sections[rela_text_func].data = (
+		pack_rela(0x10, prolog, R_PPC_REL24, 0)
+		+ pack_rela(0x20, game_symbols[0], R_PPC_REL24, 0)
+		+ pack_rela(0x24, data_symbol, R_PPC_ADDR32, 0x10))
+	sections[rela_data].data = b"".join(
+		pack_rela(i * 8, rng.choice(game_symbols + [prolog, data_symbol]), R_PPC_ADDR32, i) for i in range(32))
+	sections[rela_ctors].data = pack_rela(0, prolog, R_PPC_ADDR32, 0) + pack_rela(4, epilog, R_PPC_ADDR32, 0)
+	if debug_size:
+		sections[rela_sections[-1]].data = b"".join(
+			pack_rela(i * 4, rng.choice(game_symbols), R_PPC_ADDR32, 0) for i in range(min(100, debug_size // 4)))
+
+	sections[symtab].data = b"".join(struct.pack(">IIIBBH", *symbol) for symbol in symbols)
+	sections[strtab].data = bytes(strings)
+
+	section_names = bytearray(b"\0")
+	name_offsets = []
+	for section in sections:
+		name_offsets.append(len(section_names) if section.name else 0)
+		if section.name:
+			section_names.extend(section.name.encode() + b"\0")
+	sections[shstrtab].data = bytes(section_names)
+
+	# Section data right after the header, then the section header table
+	elf_header_size = 52
+	section_header_size = 40
+	output = bytearray(elf_header_size)
+	file_offsets = []
+	for section in sections:
+		if section.type in (SHT_NULL, SHT_NOBITS):
+			file_offsets.append(0)
+			continue
+		while len(output) % max(section.align, 1):
+			output.append(0)
+		file_offsets.append(len(output))
+		output.extend(section.data)
+	while len(output) % 4:
+		output.append(0)
+
+	section_header_offset = len(output)
+	for i, section in enumerate(sections):
+		size = section.size if section.type == SHT_NOBITS else len(section.data)
+		output += struct.pack(
+			">IIIIIIIIII",
+			name_offsets[i], section.type, section.flags, 0, file_offsets[i], size,
+			section.link, section.info, section.align, section.entsize)
+
+	output[0:elf_header_size] = b"\x7fELF" + bytes([1, 2, 1, 0]) + bytes(8) + struct.pack(
+		">HHIIIIIHHHHHH",
+		1,		# ET_REL
+		20,		# EM_PPC
+		1, 0, 0, section_header_offset, 0x80000000,
+		elf_header_size, 0, 0, section_header_size, len(sections), shstrtab)
+
+	with open(elf_filename, "wb") as elf_file:
+		elf_file.write(output)
+	with open(symbol_filename, "w") as symbol_file:
+		symbol_file.write("\n".join(symbol_lines) + "\n")
+
+def main():
+	parser = argparse.ArgumentParser(description="Write a synthetic ELF and symbol file for elf2rel")
+	parser.add_argument("elf", help="Output ELF filename")
+	parser.add_argument("symbols", help="Output symbol filename")
+	parser.add_argument("--symbol-count", type=int, default=100000)
+	parser.add_argument("--relocation-count", type=int, default=500000)
+	parser.add_argument("--debug-size", type=int, default=0, help="Bytes of .debug_info to add")
+	parser.add_argument("--text-sections", type=int, default=1, help="Number of sections to split the code over")
+	parser.add_argument("--seed", type=int, default=1)
+	args = parser.parse_args()
+
+	generate(args.elf, args.symbols, args.symbol_count, args.relocation_count, args.seed, args.debug_size, args.text_sections)
+
+if __name__ == "__main__":
+	main()
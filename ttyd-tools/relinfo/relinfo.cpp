@@ -0,0 +1,515 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2019 Linus S. (aka PistonMiner)
+
+#include "elf2rel.h"
+
+#include <boost/program_options.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct RelSection
+{
+	uint32_t offset;
+	uint32_t size;
+	bool executable;
+};
+
+struct RelImport
+{
+	uint32_t moduleID;
+	uint32_t offset;
+	// Entries in this import's relocation list, including the terminating END
+	uint32_t entryCount;
+};
+
+// A relocation with the stream's running offset and section already applied
+struct RelEntry
+{
+	uint32_t moduleID;
+	uint32_t section;
+	uint32_t offset;
+	uint32_t type;
+	uint32_t targetSection;
+	uint32_t addend;
+
+	bool operator<(const RelEntry &other) const
+	{
+		return std::tie(moduleID, section, offset, type, targetSection, addend)
+			   < std::tie(other.moduleID, other.section, other.offset, other.type, other.targetSection, other.addend);
+	}
+	bool operator==(const RelEntry &other) const
+	{
+		return !(*this < other) && !(other < *this);
+	}
+};
+
+// Entry counts per module, section and type, including the R_DOLPHIN_* ones
+using RelHistogram = std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t>;
+
+struct RelFile
+{
+	std::string filename;
+	size_t fileSize = 0;
+	RelModuleHeader header = RelModuleHeader();
+	std::vector<RelSection> sections;
+	std::vector<RelImport> imports;
+	std::vector<RelEntry> relocations;
+	RelHistogram histogram;
+	size_t streamEntryCount = 0;
+};
+
+bool parseRel(const uint8_t *data, size_t size, RelFile &rel, std::string &error)
+{
+	if (!readModuleHeader(data, size, rel.header))
+	{
+		error = "File too small for REL header";
+		return false;
+	}
+	const RelModuleHeader &header = rel.header;
+	rel.fileSize = size;
+
+	if (header.sectionInfoOffset > size || header.sectionCount > (size - header.sectionInfoOffset) / 8)
+	{
+		error = "Section table out of bounds";
+		return false;
+	}
+	rel.sections.resize(header.sectionCount);
+	for (uint32_t i = 0; i < header.sectionCount; ++i)
+	{
+		const uint8_t *info = data + header.sectionInfoOffset + i * 8;
+		uint32_t offset = readBigEndian<uint32_t>(info);
+		rel.sections[i].offset = offset & ~1u;
+		rel.sections[i].executable = (offset & 1) != 0;
+		rel.sections[i].size = readBigEndian<uint32_t>(info + 4);
+	}
+
+	// Linked or pre-linked modules may not have imports left at all
+	if (header.importInfoSize == 0)
+	{
+		return true;
+	}
+	if (header.importInfoOffset > size || header.importInfoSize > size - header.importInfoOffset)
+	{
+		error = "Import table out of bounds";
+		return false;
+	}
+	rel.imports.resize(header.importInfoSize / 8);
+	for (size_t i = 0; i < rel.imports.size(); ++i)
+	{
+		const uint8_t *info = data + header.importInfoOffset + i * 8;
+		RelImport &import = rel.imports[i];
+		import.moduleID = readBigEndian<uint32_t>(info);
+		import.offset = readBigEndian<uint32_t>(info + 4);
+		import.entryCount = 0;
+
+		uint32_t section = 0;
+		uint32_t offset = 0;
+		for (uint32_t entryOffset = import.offset; ; entryOffset += 8)
+		{
+			if (entryOffset > size || size - entryOffset < 8)
+			{
+				error = "Relocation list for module " + std::to_string(import.moduleID) + " runs past end of file";
+				return false;
+			}
+			const uint8_t *entry = data + entryOffset;
+			uint32_t type = entry[2];
+			++import.entryCount;
+			++rel.streamEntryCount;
+
+			offset += readBigEndian<uint16_t>(entry);
+			if (type == R_DOLPHIN_SECTION)
+			{
+				section = entry[3];
+				offset = 0;
+			}
+			++rel.histogram[std::make_tuple(import.moduleID, section, type)];
+			if (type == R_DOLPHIN_END)
+			{
+				break;
+			}
+			if (type == R_DOLPHIN_NOP || type == R_DOLPHIN_SECTION)
+			{
+				continue;
+			}
+
+			RelEntry relocation;
+			relocation.moduleID = import.moduleID;
+			relocation.section = section;
+			relocation.offset = offset;
+			relocation.type = type;
+			relocation.targetSection = entry[3];
+			relocation.addend = readBigEndian<uint32_t>(entry + 4);
+			rel.relocations.emplace_back(relocation);
+		}
+	}
+	return true;
+}
+
+bool loadRel(const std::string &filename, RelFile &rel, std::string &error)
+{
+	namespace bip = boost::interprocess;
+
+	rel.filename = filename;
+	try
+	{
+		bip::file_mapping mapping(filename.c_str(), bip::read_only);
+		bip::mapped_region region(mapping, bip::read_only);
+		return parseRel(static_cast<const uint8_t *>(region.get_address()), region.get_size(), rel, error);
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		// Mapping fails for empty files among others, just read it normally
+		std::ifstream inputStream(filename, std::ios::binary);
+		if (!inputStream)
+		{
+			error = "Failed to open file";
+			return false;
+		}
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+		return parseRel(data.data(), data.size(), rel, error);
+	}
+}
+
+void printHeader(const RelFile &rel)
+{
+	const RelModuleHeader &header = rel.header;
+	printf("%s: %u bytes\n", rel.filename.c_str(), static_cast<uint32_t>(rel.fileSize));
+	printf("  id                 %u (0x%x)\n", header.id, header.id);
+	printf("  version            %u\n", header.version);
+	printf("  sections           %u at 0x%x\n", header.sectionCount, header.sectionInfoOffset);
+	printf("  name               0x%x, %u bytes\n", header.nameOffset, header.nameSize);
+	printf("  bss size           0x%x\n", header.totalBssSize);
+	printf("  relocations        0x%x\n", header.relocationOffset);
+	printf("  imports            0x%x, %u bytes\n", header.importInfoOffset, header.importInfoSize);
+	printf("  prolog             %u:0x%x\n", header.prologSection, header.prologOffset);
+	printf("  epilog             %u:0x%x\n", header.epilogSection, header.epilogOffset);
+	printf("  unresolved         %u:0x%x\n", header.unresolvedSection, header.unresolvedOffset);
+	if (header.version >= 2)
+	{
+		printf("  align              %u, bss %u\n", header.maxAlign, header.maxBssAlign);
+	}
+	if (header.version >= 3)
+	{
+		printf("  fixed data size    0x%x\n", header.fixedDataSize);
+	}
+}
+
+void printSections(const RelFile &rel)
+{
+	printf("Sections:\n");
+	for (size_t i = 0; i < rel.sections.size(); ++i)
+	{
+		const RelSection &section = rel.sections[i];
+		if (!section.offset && !section.size)
+		{
+			continue;
+		}
+		printf("  %3u  %-5s offset 0x%08x  size 0x%08x\n",
+			   static_cast<uint32_t>(i),
+			   section.offset ? (section.executable ? "exec" : "data") : "bss",
+			   section.offset,
+			   section.size);
+	}
+}
+
+void printImports(const RelFile &rel)
+{
+	printf("Imports:\n");
+	for (const auto &import : rel.imports)
+	{
+		printf("  module %-6u list at 0x%08x  %8u entries %10u bytes\n",
+			   import.moduleID,
+			   import.offset,
+			   import.entryCount,
+			   import.entryCount * 8);
+	}
+}
+
+void printHistogram(const RelFile &rel)
+{
+	printf("Relocation entries by module, section and type:\n");
+	std::map<uint32_t, uint32_t> typeTotals;
+	for (const auto &it : rel.histogram)
+	{
+		printf("  module %-6u section %-3u %-24s %8u\n",
+			   std::get<0>(it.first),
+			   std::get<1>(it.first),
+			   getRelocationTypeName(std::get<2>(it.first)),
+			   it.second);
+		typeTotals[std::get<2>(it.first)] += it.second;
+	}
+	printf("Totals by type:\n");
+	for (const auto &it : typeTotals)
+	{
+		printf("  %-24s %8u entries %10u bytes\n", getRelocationTypeName(it.first), it.second, it.second * 8);
+	}
+}
+
+void printSummaryLine(const char *name, size_t fileSize, size_t sectionCount, size_t importCount,
+					  size_t relocationCount, size_t streamEntryCount, size_t bssSize)
+{
+	printf("%10u %5u %5u %9u %10u %9u  %s\n",
+		   static_cast<uint32_t>(fileSize),
+		   static_cast<uint32_t>(sectionCount),
+		   static_cast<uint32_t>(importCount),
+		   static_cast<uint32_t>(relocationCount),
+		   static_cast<uint32_t>(streamEntryCount * 8),
+		   static_cast<uint32_t>(bssSize),
+		   name);
+}
+
+// Prints the differences between two RELs, returns whether there were any
+bool diffRels(const RelFile &left, const RelFile &right)
+{
+	bool different = false;
+	printf("--- %s\n+++ %s\n", left.filename.c_str(), right.filename.c_str());
+
+	auto diffValue = [&](const char *name, uint32_t leftValue, uint32_t rightValue)
+	{
+		if (leftValue != rightValue)
+		{
+			printf("  %-20s 0x%x -> 0x%x (%+d)\n",
+				   name,
+				   leftValue,
+				   rightValue,
+				   static_cast<int>(rightValue - leftValue));
+			different = true;
+		}
+	};
+	diffValue("file size", static_cast<uint32_t>(left.fileSize), static_cast<uint32_t>(right.fileSize));
+	diffValue("id", left.header.id, right.header.id);
+	diffValue("version", left.header.version, right.header.version);
+	diffValue("section count", left.header.sectionCount, right.header.sectionCount);
+	diffValue("bss size", left.header.totalBssSize, right.header.totalBssSize);
+	diffValue("import size", left.header.importInfoSize, right.header.importInfoSize);
+	diffValue("prolog section", left.header.prologSection, right.header.prologSection);
+	diffValue("prolog offset", left.header.prologOffset, right.header.prologOffset);
+	diffValue("epilog section", left.header.epilogSection, right.header.epilogSection);
+	diffValue("epilog offset", left.header.epilogOffset, right.header.epilogOffset);
+	diffValue("unresolved section", left.header.unresolvedSection, right.header.unresolvedSection);
+	diffValue("unresolved offset", left.header.unresolvedOffset, right.header.unresolvedOffset);
+	diffValue("max align", left.header.maxAlign, right.header.maxAlign);
+	diffValue("max bss align", left.header.maxBssAlign, right.header.maxBssAlign);
+	diffValue("fixed data size", left.header.fixedDataSize, right.header.fixedDataSize);
+	diffValue("stream bytes",
+			  static_cast<uint32_t>(left.streamEntryCount * 8),
+			  static_cast<uint32_t>(right.streamEntryCount * 8));
+
+	size_t sectionCount = std::max(left.sections.size(), right.sections.size());
+	for (size_t i = 0; i < sectionCount; ++i)
+	{
+		RelSection empty = {};
+		const RelSection &leftSection = i < left.sections.size() ? left.sections[i] : empty;
+		const RelSection &rightSection = i < right.sections.size() ? right.sections[i] : empty;
+		if (leftSection.size != rightSection.size || leftSection.executable != rightSection.executable)
+		{
+			printf("  section %-3u size 0x%x -> 0x%x (%+d)%s\n",
+				   static_cast<uint32_t>(i),
+				   leftSection.size,
+				   rightSection.size,
+				   static_cast<int>(rightSection.size - leftSection.size),
+				   leftSection.executable != rightSection.executable ? ", exec flag changed" : "");
+			different = true;
+		}
+	}
+
+	// Walk both histograms in key order at once
+	auto leftIt = left.histogram.begin();
+	auto rightIt = right.histogram.begin();
+	while (leftIt != left.histogram.end() || rightIt != right.histogram.end())
+	{
+		bool useLeft = rightIt == right.histogram.end()
+					   || (leftIt != left.histogram.end() && leftIt->first <= rightIt->first);
+		bool useRight = leftIt == left.histogram.end()
+						|| (rightIt != right.histogram.end() && rightIt->first <= leftIt->first);
+		const auto &key = useLeft ? leftIt->first : rightIt->first;
+		uint32_t leftCount = useLeft ? leftIt->second : 0;
+		uint32_t rightCount = useRight ? rightIt->second : 0;
+		if (leftCount != rightCount)
+		{
+			printf("  module %-6u section %-3u %-24s %8u -> %8u (%+d)\n",
+				   std::get<0>(key),
+				   std::get<1>(key),
+				   getRelocationTypeName(std::get<2>(key)),
+				   leftCount,
+				   rightCount,
+				   static_cast<int>(rightCount - leftCount));
+			different = true;
+		}
+		if (useLeft)
+			++leftIt;
+		if (useRight)
+			++rightIt;
+	}
+
+	// Relocation level differences, only the first few are listed
+	std::vector<RelEntry> leftRelocations = left.relocations;
+	std::vector<RelEntry> rightRelocations = right.relocations;
+	std::sort(leftRelocations.begin(), leftRelocations.end());
+	std::sort(rightRelocations.begin(), rightRelocations.end());
+	std::vector<RelEntry> removed;
+	std::vector<RelEntry> added;
+	std::set_difference(leftRelocations.begin(), leftRelocations.end(),
+						rightRelocations.begin(), rightRelocations.end(),
+						std::back_inserter(removed));
+	std::set_difference(rightRelocations.begin(), rightRelocations.end(),
+						leftRelocations.begin(), leftRelocations.end(),
+						std::back_inserter(added));
+	const size_t cMaxListed = 20;
+	auto printRelocations = [&](const std::vector<RelEntry> &relocations, char prefix)
+	{
+		for (size_t i = 0; i < relocations.size() && i < cMaxListed; ++i)
+		{
+			const RelEntry &rel = relocations[i];
+			printf("  %c module %-6u %3u:0x%08x %-24s -> %3u:0x%08x\n",
+				   prefix,
+				   rel.moduleID,
+				   rel.section,
+				   rel.offset,
+				   getRelocationTypeName(rel.type),
+				   rel.targetSection,
+				   rel.addend);
+		}
+		if (relocations.size() > cMaxListed)
+		{
+			printf("  %c ... %u more\n", prefix, static_cast<uint32_t>(relocations.size() - cMaxListed));
+		}
+	};
+	if (!removed.empty() || !added.empty())
+	{
+		printf("  relocations: %u removed, %u added\n",
+			   static_cast<uint32_t>(removed.size()),
+			   static_cast<uint32_t>(added.size()));
+		printRelocations(removed, '-');
+		printRelocations(added, '+');
+		different = true;
+	}
+
+	if (!different)
+	{
+		printf("  structurally identical\n");
+	}
+	return different;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> relFilenames;
+	bool summaryMode = false;
+	bool diffMode = false;
+
+	{
+		namespace po = boost::program_options;
+
+		po::options_description description("Options");
+		description.add_options()
+			("help", "Print help message")
+			("input-file,i", po::value(&relFilenames), "Input REL filenames (required)")
+			("summary", po::bool_switch(&summaryMode), "Print one line per REL with totals instead of full dumps")
+			("diff", po::bool_switch(&diffMode), "Structurally compare exactly two RELs");
+
+		po::positional_options_description positionals;
+		positionals.add("input-file", -1);
+
+		po::variables_map varMap;
+		po::store(
+			po::command_line_parser(argc, argv)
+				.options(description)
+				.positional(positionals)
+				.run(),
+			varMap
+		);
+		po::notify(varMap);
+
+		if (varMap.count("help")
+			|| relFilenames.empty()
+			|| (diffMode && relFilenames.size() != 2)
+			|| (diffMode && summaryMode))
+		{
+			std::cout << description << "\n";
+			return 1;
+		}
+	}
+
+	if (diffMode)
+	{
+		RelFile rels[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			std::string error;
+			if (!loadRel(relFilenames[i], rels[i], error))
+			{
+				printf("%s: %s\n", relFilenames[i].c_str(), error.c_str());
+				return 1;
+			}
+		}
+		return diffRels(rels[0], rels[1]) ? 1 : 0;
+	}
+
+	if (summaryMode)
+	{
+		printf("%10s %5s %5s %9s %10s %9s  %s\n", "size", "sects", "imps", "relocs", "rel bytes", "bss", "file");
+	}
+
+	int failedCount = 0;
+	size_t totalFileSize = 0, totalSections = 0, totalImports = 0;
+	size_t totalRelocations = 0, totalStreamEntries = 0, totalBssSize = 0;
+	for (const auto &filename : relFilenames)
+	{
+		// One at a time, so memory stays flat no matter how many files there are
+		RelFile rel;
+		std::string error;
+		if (!loadRel(filename, rel, error))
+		{
+			printf("%s: %s\n", filename.c_str(), error.c_str());
+			++failedCount;
+			continue;
+		}
+
+		if (summaryMode)
+		{
+			printSummaryLine(filename.c_str(),
+							 rel.fileSize,
+							 rel.sections.size(),
+							 rel.imports.size(),
+							 rel.relocations.size(),
+							 rel.streamEntryCount,
+							 rel.header.totalBssSize);
+			totalFileSize += rel.fileSize;
+			totalSections += rel.sections.size();
+			totalImports += rel.imports.size();
+			totalRelocations += rel.relocations.size();
+			totalStreamEntries += rel.streamEntryCount;
+			totalBssSize += rel.header.totalBssSize;
+		}
+		else
+		{
+			printHeader(rel);
+			printSections(rel);
+			printImports(rel);
+			printHistogram(rel);
+			printf("\n");
+		}
+	}
+
+	if (summaryMode)
+	{
+		printSummaryLine("total",
+						 totalFileSize,
+						 totalSections,
+						 totalImports,
+						 totalRelocations,
+						 totalStreamEntries,
+						 totalBssSize);
+	}
+	return failedCount ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include "image.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+bool Image::addRegion(const std::string &filename, uint32_t baseAddress, std::string *error)
+{
+	namespace bip = boost::interprocess;
+
+	auto setError = [&](const std::string &message)
+	{
+		if (error)
+		{
+			*error = message;
+		}
+		return false;
+	};
+
+	std::unique_ptr<Mapping> mapping(new Mapping);
+	const uint8_t *data;
+	size_t size;
+	try
+	{
+		mapping->file = bip::file_mapping(filename.c_str(), bip::read_only);
+		mapping->region = bip::mapped_region(mapping->file, bip::read_only);
+		data = static_cast<const uint8_t *>(mapping->region.get_address());
+		size = mapping->region.get_size();
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		// Mapping fails for empty files among others, just read it normally
+		std::ifstream inputStream(filename, std::ios::binary);
+		if (!inputStream)
+		{
+			return setError("Failed to open input file '" + filename + "'");
+		}
+		mapping->fallbackData.assign(std::istreambuf_iterator<char>(inputStream), std::istreambuf_iterator<char>());
+		data = mapping->fallbackData.data();
+		size = mapping->fallbackData.size();
+	}
+
+	if (size > 0x100000000ull - baseAddress)
+	{
+		return setError("Input file '" + filename + "' does not fit at its base address");
+	}
+
+	Region region;
+	region.filename = filename;
+	region.baseAddress = baseAddress;
+	region.size = static_cast<uint32_t>(size);
+	region.data = data;
+
+	auto it = std::lower_bound(mRegions.begin(), mRegions.end(), baseAddress, [](const Region &existing, uint32_t address)
+	{
+		return existing.baseAddress < address;
+	});
+	bool overlapsNext = it != mRegions.end() && region.size && it->baseAddress - baseAddress < region.size;
+	bool overlapsPrevious = it != mRegions.begin() && baseAddress - (it - 1)->baseAddress < (it - 1)->size;
+	if (overlapsNext || overlapsPrevious)
+	{
+		const Region &other = overlapsNext ? *it : *(it - 1);
+		return setError("Input file '" + filename + "' overlaps '" + other.filename + "'");
+	}
+
+	mRegions.insert(it, region);
+	mMappings.emplace_back(std::move(mapping));
+	return true;
+}
+
+bool Image::contains(uint32_t address, uint32_t size) const
+{
+	return getData(address, size) != nullptr;
+}
+
+const uint8_t *Image::getData(uint32_t address, uint32_t size) const
+{
+	const Region *region = findRegion(address);
+	if (!region)
+	{
+		return nullptr;
+	}
+
+	uint32_t offset = address - region->baseAddress;
+	if (size > region->size - offset)
+	{
+		return nullptr;
+	}
+	return region->data + offset;
+}
+
+bool Image::readU32(uint32_t address, uint32_t &value) const
+{
+	const uint8_t *data = getData(address, sizeof(uint32_t));
+	if (!data)
+	{
+		return false;
+	}
+
+	value = static_cast<uint32_t>(data[0]) << 24
+		  | static_cast<uint32_t>(data[1]) << 16
+		  | static_cast<uint32_t>(data[2]) << 8
+		  | static_cast<uint32_t>(data[3]);
+	return true;
+}
+
+const Image::Region *Image::findRegion(uint32_t address) const
+{
+	// Last region starting at or below the address
+	auto it = std::upper_bound(mRegions.begin(), mRegions.end(), address, [](uint32_t address, const Region &region)
+	{
+		return address < region.baseAddress;
+	});
+	if (it == mRegions.begin() || address - (it - 1)->baseAddress >= (it - 1)->size)
+	{
+		return nullptr;
+	}
+	return &*(it - 1);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Memory image assembled from one or more input files, each placed at its own
+// base address. Files are mapped rather than read so that large RAM dumps are
+// only paged in where scripts are actually disassembled. All reads are bounds
+// checked, reads outside of every region fail instead of touching memory.
+// Lookups do not modify the image, so it can be shared between threads.
+class Image
+{
+public:
+	struct Region
+	{
+		std::string filename;
+		uint32_t baseAddress;
+		uint32_t size;
+		const uint8_t *data;
+	};
+
+	// Maps the file at the given address. Fails if the file cannot be read, does
+	// not fit into the 32-bit address space or overlaps an existing region.
+	bool addRegion(const std::string &filename, uint32_t baseAddress, std::string *error = nullptr);
+
+	// True if [address, address + size) lies within a single region
+	bool contains(uint32_t address, uint32_t size = 1) const;
+
+	// Pointer to size bytes at address, or nullptr if they are not all loaded
+	const uint8_t *getData(uint32_t address, uint32_t size) const;
+
+	bool readU32(uint32_t address, uint32_t &value) const;
+
+	const std::vector<Region> &getRegions() const
+	{
+		return mRegions;
+	}
+
+private:
+	const Region *findRegion(uint32_t address) const;
+
+private:
+	struct Mapping
+	{
+		boost::interprocess::file_mapping file;
+		boost::interprocess::mapped_region region;
+		std::vector<uint8_t> fallbackData;
+	};
+
+	// Sorted by base address
+	std::vector<Region> mRegions;
+	std::vector<std::unique_ptr<Mapping>> mMappings;
+};
@@ -0,0 +1,406 @@
+#include "scanner.h"
+
+#include "image.h"
+#include "ttydasm.h"
+
+#include <algorithm>
+
+namespace
+{
+
+enum class BlockAction : uint8_t
+{
+	None,
+	End,
+	OpenIf,
+	Else,
+	CloseIf,
+	OpenLoop,
+	CloseLoop,
+	LoopControl,
+	OpenSwitch,
+	Case,
+	SwitchControl,
+	CloseSwitch,
+	OpenThread,
+	CloseThread,
+	OpenChildThread,
+	CloseChildThread,
+};
+
+enum class Block : uint8_t
+{
+	If,
+	Else,
+	Loop,
+	Switch,
+	Thread,
+	ChildThread,
+};
+
+struct OpcodeInfo
+{
+	bool valid;
+	uint16_t minParams;
+	uint16_t maxParams;
+	BlockAction action;
+};
+
+// Largest parameter count any opcode accepts, for the prefilter
+const uint16_t cMaxParamCount = 64;
+const int cMaxBlockDepth = 64;
+
+static_assert(OP_Count <= 0x100 && cMaxParamCount < 0x100, "prefilter only checks the low byte of opcode and parameter count");
+
+OpcodeInfo getOpcodeInfo(int opcode)
+{
+	auto info = [](uint16_t minParams, uint16_t maxParams, BlockAction action = BlockAction::None)
+	{
+		return OpcodeInfo { true, minParams, maxParams, action };
+	};
+
+	switch (opcode)
+	{
+	case OP_ScriptEnd:				return info(0, 0, BlockAction::End);
+	case OP_Return:					return info(0, 0);
+	case OP_Label:
+	case OP_Goto:					return info(1, 1);
+	case OP_LoopBegin:				return info(1, 1, BlockAction::OpenLoop);
+	case OP_LoopIterate:			return info(0, 0, BlockAction::CloseLoop);
+	case OP_LoopBreak:
+	case OP_LoopContinue:			return info(0, 0, BlockAction::LoopControl);
+	case OP_WaitFrames:
+	case OP_WaitMS:
+	case OP_WaitUntil:				return info(1, 1);
+	case OP_IfStringEqual:
+	case OP_IfStringNotEqual:
+	case OP_IfStringLess:
+	case OP_IfStringGreater:
+	case OP_IfStringLessEqual:
+	case OP_IfStringGreaterEqual:
+	case OP_IfFloatEqual:
+	case OP_IfFloatNotEqual:
+	case OP_IfFloatLess:
+	case OP_IfFloatGreater:
+	case OP_IfFloatLessEqual:
+	case OP_IfFloatGreaterEqual:
+	case OP_IfIntEqual:
+	case OP_IfIntNotEqual:
+	case OP_IfIntLess:
+	case OP_IfIntGreater:
+	case OP_IfIntLessEqual:
+	case OP_IfIntGreaterEqual:
+	case OP_IfBitsSet:
+	case OP_IfBitsClear:			return info(2, 2, BlockAction::OpenIf);
+	case OP_Else:					return info(0, 0, BlockAction::Else);
+	case OP_EndIf:					return info(0, 0, BlockAction::CloseIf);
+	case OP_SwitchExpr:
+	case OP_SwitchRaw:				return info(1, 1, BlockAction::OpenSwitch);
+	case OP_CaseIntEqual:
+	case OP_CaseIntNotEqual:
+	case OP_CaseIntLess:
+	case OP_CaseIntGreater:
+	case OP_CaseIntLessEqual:
+	case OP_CaseIntGreaterEqual:
+	case OP_CaseIntEqualAny:
+	case OP_CaseIntNotEqualAll:
+	case OP_CaseBitsSet:			return info(1, 1, BlockAction::Case);
+	case OP_CaseDefault:
+	case OP_EndMultiCase:			return info(0, 0, BlockAction::Case);
+	case OP_SwitchBreak:			return info(0, 0, BlockAction::SwitchControl);
+	case OP_CaseIntRange:			return info(2, 2, BlockAction::Case);
+	case OP_EndSwitch:				return info(0, 0, BlockAction::CloseSwitch);
+	case OP_SetExprIntToExprInt:
+	case OP_SetExprIntToRaw:
+	case OP_SetExprFloatToExprFloat:
+	case OP_AddInt:
+	case OP_SubtractInt:
+	case OP_MultiplyInt:
+	case OP_DivideInt:
+	case OP_ModuloInt:
+	case OP_AddFloat:
+	case OP_SubtractFloat:
+	case OP_MultiplyFloat:
+	case OP_DivideFloat:			return info(2, 2);
+	case OP_MemOpSetBaseInt:
+	case OP_MemOpReadInt:			return info(1, 1);
+	case OP_MemOpReadInt2:			return info(2, 2);
+	case OP_MemOpReadInt3:			return info(3, 3);
+	case OP_MemOpReadInt4:			return info(4, 4);
+	case OP_MemOpReadIntIndexed:	return info(2, 2);
+	case OP_MemOpSetBaseFloat:
+	case OP_MemOpReadFloat:			return info(1, 1);
+	case OP_MemOpReadFloat2:		return info(2, 2);
+	case OP_MemOpReadFloat3:		return info(3, 3);
+	case OP_MemOpReadFloat4:		return info(4, 4);
+	case OP_MemOpReadFloatIndexed:	return info(2, 2);
+#ifdef GAME_SPM
+	case OP_ClampInt:				return info(1, 3);
+#endif
+	case OP_SetUserWordBase:
+	case OP_SetUserFlagBase:		return info(1, 1);
+	case OP_AllocateUserWordBase:
+	case OP_AndExpr:
+	case OP_AndRaw:
+	case OP_OrExpr:
+	case OP_OrRaw:
+	case OP_ConvertMSToFrames:
+	case OP_ConvertFramesToMS:
+	case OP_StoreIntToPtr:
+	case OP_StoreFloatToPtr:
+	case OP_LoadIntFromPtr:
+	case OP_LoadFloatFromPtr:
+	case OP_StoreIntToPtrExpr:
+	case OP_StoreFloatToPtrExpr:
+	case OP_LoadIntFromPtrExpr:
+	case OP_LoadFloatFromPtrExpr:	return info(2, 2);
+	case OP_CallCppSync:			return info(1, cMaxParamCount);
+	case OP_CallScriptAsync:		return info(1, 1);
+	case OP_CallScriptAsyncSaveTID:	return info(2, 2);
+	case OP_CallScriptSync:
+	case OP_TerminateThread:
+	case OP_Jump:
+	case OP_SetThreadPriority:
+	case OP_SetThreadTimeQuantum:
+	case OP_SetThreadTypeMask:
+	case OP_ThreadSuspendTypes:
+	case OP_ThreadResumeTypes:
+	case OP_ThreadSuspendTypesOther:
+	case OP_ThreadResumeTypesOther:
+	case OP_ThreadSuspendTID:
+	case OP_ThreadResumeTID:		return info(1, 1);
+	case OP_CheckThreadRunning:		return info(2, 2);
+	case OP_ThreadStart:			return info(0, 0, BlockAction::OpenThread);
+	case OP_ThreadStartSaveTID:		return info(1, 1, BlockAction::OpenThread);
+	case OP_ThreadEnd:				return info(0, 0, BlockAction::CloseThread);
+	case OP_ThreadChildStart:		return info(0, 0, BlockAction::OpenChildThread);
+	case OP_ThreadChildStartSaveTID:return info(1, 1, BlockAction::OpenChildThread);
+	case OP_ThreadChildEnd:			return info(0, 0, BlockAction::CloseChildThread);
+	case OP_DebugOutputString:
+	case OP_DebugUnk1:
+	case OP_DebugExprToString:
+	case OP_DebugUnk2:
+	case OP_DebugUnk3:				return info(0, 1);
+	default:						return OpcodeInfo { false, 0, 0, BlockAction::None };
+	}
+}
+
+struct OpcodeTable
+{
+	OpcodeInfo opcodes[OP_Count];
+
+	OpcodeTable()
+	{
+		for (int i = 0; i < OP_Count; ++i)
+		{
+			opcodes[i] = getOpcodeInfo(i);
+		}
+	}
+};
+
+const OpcodeTable &getOpcodeTable()
+{
+	static const OpcodeTable sTable;
+	return sTable;
+}
+
+inline uint32_t readWord(const uint8_t *data)
+{
+	return static_cast<uint32_t>(data[0]) << 24
+		 | static_cast<uint32_t>(data[1]) << 16
+		 | static_cast<uint32_t>(data[2]) << 8
+		 | static_cast<uint32_t>(data[3]);
+}
+
+// Decodes instructions from offset on, returns the offset after the final end
+// if they form a complete script, or 0 if they do not.
+uint32_t walkScript(const uint8_t *data, uint32_t size, uint32_t offset, const ScanOptions &options)
+{
+	const OpcodeTable &table = getOpcodeTable();
+
+	Block blocks[cMaxBlockDepth];
+	int depth = 0;
+	auto isTop = [&](Block block)
+	{
+		return depth > 0 && blocks[depth - 1] == block;
+	};
+	// Loop and switch control may be nested in other blocks of their loop or case
+	auto isOpen = [&](Block block)
+	{
+		for (int i = depth - 1; i >= 0; --i)
+		{
+			if (blocks[i] == block)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+	auto push = [&](Block block)
+	{
+		if (depth == cMaxBlockDepth)
+		{
+			return false;
+		}
+		blocks[depth++] = block;
+		return true;
+	};
+	auto pop = [&](Block block)
+	{
+		if (!isTop(block))
+		{
+			return false;
+		}
+		--depth;
+		return true;
+	};
+
+	for (uint32_t count = 1; count <= options.maxInstructionCount; ++count)
+	{
+		if (size - offset < sizeof(uint32_t))
+		{
+			return 0;
+		}
+
+		uint32_t header = readWord(data + offset);
+		uint32_t opcode = header & 0xFFFF;
+		uint32_t paramCount = header >> 16;
+		if (opcode >= OP_Count)
+		{
+			return 0;
+		}
+		const OpcodeInfo &info = table.opcodes[opcode];
+		if (!info.valid || paramCount < info.minParams || paramCount > info.maxParams)
+		{
+			return 0;
+		}
+		offset += sizeof(uint32_t);
+		if (size - offset < paramCount * sizeof(uint32_t))
+		{
+			return 0;
+		}
+		offset += paramCount * sizeof(uint32_t);
+
+		bool valid = true;
+		switch (info.action)
+		{
+		case BlockAction::None:
+			break;
+		case BlockAction::End:
+			if (depth != 0 || count < options.minInstructionCount)
+			{
+				return 0;
+			}
+			return offset;
+		case BlockAction::OpenIf:
+			valid = push(Block::If);
+			break;
+		case BlockAction::Else:
+			valid = isTop(Block::If);
+			if (valid)
+			{
+				blocks[depth - 1] = Block::Else;
+			}
+			break;
+		case BlockAction::CloseIf:
+			valid = pop(Block::If) || pop(Block::Else);
+			break;
+		case BlockAction::OpenLoop:
+			valid = push(Block::Loop);
+			break;
+		case BlockAction::CloseLoop:
+			valid = pop(Block::Loop);
+			break;
+		case BlockAction::LoopControl:
+			valid = isOpen(Block::Loop);
+			break;
+		case BlockAction::OpenSwitch:
+			valid = push(Block::Switch);
+			break;
+		case BlockAction::Case:
+			valid = isTop(Block::Switch);
+			break;
+		case BlockAction::SwitchControl:
+			valid = isOpen(Block::Switch);
+			break;
+		case BlockAction::CloseSwitch:
+			valid = pop(Block::Switch);
+			break;
+		case BlockAction::OpenThread:
+			valid = push(Block::Thread);
+			break;
+		case BlockAction::CloseThread:
+			valid = pop(Block::Thread);
+			break;
+		case BlockAction::OpenChildThread:
+			valid = push(Block::ChildThread);
+			break;
+		case BlockAction::CloseChildThread:
+			valid = pop(Block::ChildThread);
+			break;
+		}
+		if (!valid)
+		{
+			return 0;
+		}
+	}
+	return 0;
+}
+
+}
+
+std::vector<uint32_t> scanForScripts(const Image &image, const ScanOptions &options)
+{
+	// Words are checked in blocks without branches first, only words that
+	// could be an instruction header at all get the full table check and walk.
+	// The block loop is kept simple enough for the compiler to vectorise.
+	const uint32_t cBlockWordCount = 1024;
+	uint8_t candidates[cBlockWordCount];
+
+	std::vector<uint32_t> scripts;
+	for (const auto &region : image.getRegions())
+	{
+		// Scripts are word aligned in memory, and cannot span regions
+		uint32_t start = (4 - (region.baseAddress & 3)) & 3;
+		if (region.size < start + sizeof(uint32_t))
+		{
+			continue;
+		}
+		uint32_t wordCount = (region.size - start) / sizeof(uint32_t);
+		const uint8_t *words = region.data + start;
+
+		uint32_t nextOffset = 0;
+		for (uint32_t blockStart = 0; blockStart < wordCount; blockStart += cBlockWordCount)
+		{
+			uint32_t blockSize = std::min(cBlockWordCount, wordCount - blockStart);
+			const uint8_t *block = words + blockStart * sizeof(uint32_t);
+			for (uint32_t i = 0; i < blockSize; ++i)
+			{
+				// Big-endian header: parameter count in the upper, opcode in the
+				// lower half. Both fit into the low byte of their half.
+				const uint8_t *header = block + i * sizeof(uint32_t);
+				candidates[i] = (header[0] == 0)
+							  & (header[1] <= cMaxParamCount)
+							  & (header[2] == 0)
+							  & (static_cast<uint8_t>(header[3] - 1) < OP_Count - 1);
+			}
+
+			for (uint32_t i = 0; i < blockSize; ++i)
+			{
+				uint32_t offset = start + (blockStart + i) * static_cast<uint32_t>(sizeof(uint32_t));
+				if (!candidates[i] || offset < nextOffset)
+				{
+					continue;
+				}
+
+				uint32_t endOffset = walkScript(region.data, region.size, offset, options);
+				if (endOffset)
+				{
+					scripts.push_back(region.baseAddress + offset);
+					nextOffset = endOffset;
+				}
+			}
+		}
+	}
+	return scripts;
+}
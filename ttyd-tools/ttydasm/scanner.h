@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Image;
+
+struct ScanOptions
+{
+	// Scripts with fewer instructions, including the final end, are ignored
+	uint32_t minInstructionCount = 2;
+	// Walks are abandoned after this many instructions
+	uint32_t maxInstructionCount = 0x4000;
+};
+
+// Finds everything in the image that decodes as a complete script: every
+// header has a known opcode with a parameter count it accepts, blocks (if,
+// loop, switch, threads) are properly nested and it ends on OP_ScriptEnd at
+// block depth zero. Returns the start addresses in ascending order. Scripts
+// never overlap, scanning resumes after the end of every script found.
+std::vector<uint32_t> scanForScripts(const Image &image, const ScanOptions &options = ScanOptions());
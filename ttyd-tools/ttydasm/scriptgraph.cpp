@@ -0,0 +1,202 @@
+#include "scriptgraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <tuple>
+
+namespace
+{
+
+const char *getCallName(uint16_t opcode)
+{
+	switch (opcode)
+	{
+	case OP_CallCppSync: return "callc";
+	case OP_CallScriptAsync: return "callsa";
+	case OP_CallScriptAsyncSaveTID: return "callsa_tid";
+	case OP_CallScriptSync: return "callss";
+	default: return "unknown";
+	}
+}
+
+std::string getNodeName(const SymbolMap &symbolMap, uint32_t address)
+{
+	auto it = symbolMap.find(address);
+	if (it != symbolMap.end())
+	{
+		return it->second;
+	}
+
+	char name[16];
+	snprintf(name, sizeof(name), "%08X", address);
+	return name;
+}
+
+std::string escapeString(const std::string &value)
+{
+	std::string escaped = "\"";
+	for (char c : value)
+	{
+		switch (c)
+		{
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+				escaped += code;
+			}
+			else
+			{
+				escaped += c;
+			}
+			break;
+		}
+	}
+	return escaped + "\"";
+}
+
+}
+
+bool ScriptGraph::addScript(uint32_t address)
+{
+	if (!mVisited.insert(address).second)
+	{
+		return false;
+	}
+	mScripts.push_back(address);
+	return true;
+}
+
+void ScriptGraph::addCall(uint32_t caller, const ScriptCall &call)
+{
+	mCalls.emplace_back(caller, call);
+}
+
+std::vector<ScriptGraph::Edge> ScriptGraph::getEdges() const
+{
+	std::vector<Edge> edges;
+	edges.reserve(mCalls.size());
+	for (const auto &call : mCalls)
+	{
+		edges.push_back({ call.first, call.second.target, call.second.opcode, 1 });
+	}
+
+	std::sort(edges.begin(), edges.end(), [](const Edge &left, const Edge &right)
+	{
+		return std::tie(left.caller, left.target, left.opcode) < std::tie(right.caller, right.target, right.opcode);
+	});
+
+	std::vector<Edge> merged;
+	for (const auto &edge : edges)
+	{
+		if (!merged.empty()
+			&& merged.back().caller == edge.caller
+			&& merged.back().target == edge.target
+			&& merged.back().opcode == edge.opcode)
+		{
+			++merged.back().count;
+			continue;
+		}
+		merged.push_back(edge);
+	}
+	return merged;
+}
+
+bool ScriptGraph::saveDot(const std::string &filename, const SymbolMap &symbolMap) const
+{
+	std::vector<Edge> edges = getEdges();
+
+	std::set<uint32_t> scripts(mScripts.begin(), mScripts.end());
+	std::set<uint32_t> functions;
+	for (const auto &edge : edges)
+	{
+		(edge.opcode == OP_CallCppSync ? functions : scripts).insert(edge.target);
+	}
+
+	std::ofstream outputStream(filename);
+	char id[16];
+	outputStream << "digraph scripts {\n";
+	for (uint32_t script : scripts)
+	{
+		snprintf(id, sizeof(id), "s_%08X", script);
+		outputStream << "\t" << id << " [label=" << escapeString(getNodeName(symbolMap, script)) << "];\n";
+	}
+	for (uint32_t function : functions)
+	{
+		snprintf(id, sizeof(id), "f_%08X", function);
+		outputStream << "\t" << id << " [label=" << escapeString(getNodeName(symbolMap, function)) << ", shape=box];\n";
+	}
+	for (const auto &edge : edges)
+	{
+		char line[64];
+		snprintf(line, sizeof(line), "\ts_%08X -> %c_%08X",
+				 edge.caller,
+				 edge.opcode == OP_CallCppSync ? 'f' : 's',
+				 edge.target);
+		outputStream << line;
+		if (edge.opcode == OP_CallScriptAsync || edge.opcode == OP_CallScriptAsyncSaveTID)
+		{
+			outputStream << " [style=dashed]";
+		}
+		outputStream << ";\n";
+	}
+	outputStream << "}\n";
+	return outputStream.good();
+}
+
+bool ScriptGraph::saveJson(const std::string &filename, const SymbolMap &symbolMap) const
+{
+	std::vector<Edge> edges = getEdges();
+
+	std::set<uint32_t> scripts(mScripts.begin(), mScripts.end());
+	std::set<uint32_t> functions;
+	for (const auto &edge : edges)
+	{
+		(edge.opcode == OP_CallCppSync ? functions : scripts).insert(edge.target);
+	}
+
+	auto formatNodes = [&](const std::set<uint32_t> &nodes, bool markDisassembled)
+	{
+		std::string json = "[";
+		for (auto it = nodes.begin(); it != nodes.end(); ++it)
+		{
+			char address[16];
+			snprintf(address, sizeof(address), "%u", *it);
+			json += it == nodes.begin() ? "\n" : ",\n";
+			json += "\t\t{\"address\": ";
+			json += address;
+			json += ", \"name\": " + escapeString(getNodeName(symbolMap, *it));
+			if (markDisassembled)
+			{
+				json += mVisited.count(*it) ? ", \"disassembled\": true" : ", \"disassembled\": false";
+			}
+			json += "}";
+		}
+		return json + (nodes.empty() ? "]" : "\n\t]");
+	};
+
+	std::ofstream outputStream(filename);
+	outputStream << "{\n\t\"scripts\": " << formatNodes(scripts, true);
+	outputStream << ",\n\t\"functions\": " << formatNodes(functions, false);
+	outputStream << ",\n\t\"calls\": [";
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		const Edge &edge = edges[i];
+		char line[128];
+		snprintf(line, sizeof(line), "%s\t\t{\"caller\": %u, \"target\": %u, \"type\": \"%s\", \"count\": %u}",
+				 i ? ",\n" : "\n",
+				 edge.caller,
+				 edge.target,
+				 getCallName(edge.opcode),
+				 edge.count);
+		outputStream << line;
+	}
+	outputStream << (edges.empty() ? "]" : "\n\t]") << "\n}\n";
+	return outputStream.good();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ttydasm.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Call of another script or a C function by a script instruction
+struct ScriptCall
+{
+	uint32_t target;
+	uint16_t opcode;
+};
+
+// Scripts to disassemble in the order they were found, together with the
+// calls between them. Doubles as the work queue: scripts are only ever
+// appended, so callers can walk getScripts() by index while adding more.
+class ScriptGraph
+{
+public:
+	// Returns false if the script is already known
+	bool addScript(uint32_t address);
+	void addCall(uint32_t caller, const ScriptCall &call);
+
+	const std::vector<uint32_t> &getScripts() const
+	{
+		return mScripts;
+	}
+
+	// Script nodes are ellipses, C functions boxes. Asynchronous calls are
+	// dashed edges.
+	bool saveDot(const std::string &filename, const SymbolMap &symbolMap) const;
+	// {"scripts": [...], "functions": [...], "calls": [...]}
+	bool saveJson(const std::string &filename, const SymbolMap &symbolMap) const;
+
+private:
+	struct Edge
+	{
+		uint32_t caller;
+		uint32_t target;
+		uint16_t opcode;
+		uint32_t count;
+	};
+
+	// Calls merged by caller, target and opcode, in a stable order
+	std::vector<Edge> getEdges() const;
+
+private:
+	std::vector<uint32_t> mScripts;
+	std::unordered_set<uint32_t> mVisited;
+	std::vector<std::pair<uint32_t, ScriptCall>> mCalls;
+};
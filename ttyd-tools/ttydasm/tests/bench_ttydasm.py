@@ -0,0 +1,79 @@
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import make_test_image
+
+# Times a full listing of a synthetic script image (--scan, one thread, no
+# cross-referencing) and reports the listing throughput. With --baseline the
+# same listing is produced by another build, e.g. one from before a change,
+# and both have to match apart from the version line. Options this script
+# doesn't know are passed on to ttydasm.
+
+def time_listing(executable, image_filename, symbol_filename, output_filename, runs, extra_args):
+	command = [
+		executable, "--scan", "--crossref-scripts=0", "-j", "1",
+		"--symbol-file", symbol_filename, "--input-file", image_filename] + extra_args
+	times = []
+	for _ in range(runs):
+		with open(output_filename, "wb") as output_file:
+			start = time.perf_counter()
+			result = subprocess.run(command, stdout=output_file, stderr=subprocess.PIPE)
+			times.append(time.perf_counter() - start)
+		if result.returncode != 0:
+			sys.stderr.write(result.stderr.decode(errors="replace"))
+			raise RuntimeError("{} failed with exit code {}".format(executable, result.returncode))
+	return times
+
+def print_times(name, times, output_filename):
+	output_size = os.path.getsize(output_filename)
+	print("{:<10} best {:8.3f}s  median {:8.3f}s  {:8.1f} MB/s of listing".format(
+		name, min(times), statistics.median(times), output_size / min(times) / (1 << 20)))
+
+def read_listing(filename):
+	# The first line has the build date
+	with open(filename, "rb") as listing_file:
+		return listing_file.read().split(b"\n", 1)[-1]
+
+def main():
+	parser = argparse.ArgumentParser(description="Benchmark ttydasm listings on a synthetic script image")
+	parser.add_argument("ttydasm", help="ttydasm executable to time")
+	parser.add_argument("--baseline", help="Another ttydasm executable to compare against")
+	parser.add_argument("--script-count", type=int, default=60000)
+	parser.add_argument("--runs", type=int, default=5)
+	parser.add_argument("--seed", type=int, default=1)
+	parser.add_argument("--work-dir", help="Keep the generated files here instead of a temporary directory")
+	args, extra_args = parser.parse_known_args()
+	extra_args = [arg for arg in extra_args if arg != "--"]
+
+	with tempfile.TemporaryDirectory() as temp_dir:
+		work_dir = args.work_dir or temp_dir
+		os.makedirs(work_dir, exist_ok=True)
+		image_filename = os.path.join(work_dir, "bench.bin")
+		symbol_filename = os.path.join(work_dir, "bench.sym")
+
+		print("Generating {} scripts".format(args.script_count))
+		make_test_image.generate(image_filename, symbol_filename, args.script_count, seed=args.seed)
+		print("Image size {:.1f} MB".format(os.path.getsize(image_filename) / (1 << 20)))
+
+		output_filename = os.path.join(work_dir, "bench.txt")
+		times = time_listing(args.ttydasm, image_filename, symbol_filename, output_filename, args.runs, extra_args)
+		print_times("ttydasm", times, output_filename)
+
+		if args.baseline:
+			baseline_filename = os.path.join(work_dir, "bench.baseline.txt")
+			baseline_times = time_listing(args.baseline, image_filename, symbol_filename, baseline_filename, args.runs, extra_args)
+			print_times("baseline", baseline_times, baseline_filename)
+			print("Speedup    {:.2f}x".format(min(baseline_times) / min(times)))
+
+			if read_listing(output_filename) != read_listing(baseline_filename):
+				print("Listing differs from baseline")
+				return 1
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,107 @@
+import argparse
+import os
+import random
+import re
+import struct
+
+# Writes a synthetic memory image full of event scripts, with random words in
+# between, together with a symbol file naming every script and the C
+# functions they call. The scripts use loops, conditions, switches, calls and
+# operands from most expression zones, like the game's own do.
+
+BASE_ADDRESS = 0x80000000
+FUNCTION_ADDRESS = 0x80010000
+FUNCTION_COUNT = 50
+
+# Expression zones (TTYD)
+FLOAT_BASE = -230000000
+GSW_BASE = -170000000
+LF_BASE = -70000000
+GW_BASE = -50000000
+LW_BASE = -30000000
+
+def load_opcodes():
+	# Opcode numbers come straight from the disassembler, so they can't drift
+	header_filename = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ttydasm.h")
+	with open(header_filename) as header_file:
+		header = header_file.read()
+	body = header[header.index("enum ScriptOpcode"):]
+	body = body[body.index("{") + 1:body.index("};")]
+	body = re.sub(r"#ifdef GAME_SPM.*?#endif", "", body, flags=re.S)
+	names = [name.strip() for name in body.split(",") if name.strip()]
+	return { name: index for index, name in enumerate(names) }
+
+OPCODES = load_opcodes()
+
+def instruction(opcode, *params):
+	return [(len(params) << 16) | OPCODES[opcode]] + [param & 0xFFFFFFFF for param in params]
+
+def make_script(index, callee):
+	function = FUNCTION_ADDRESS + 4 * (index % FUNCTION_COUNT)
+	words = []
+	words += instruction("OP_SetExprIntToRaw", LW_BASE, index)
+	words += instruction("OP_SetExprFloatToExprFloat", LF_BASE + 1, FLOAT_BASE + index % 4096)
+	words += instruction("OP_LoopBegin", 10)
+	words += instruction("OP_IfIntEqual", LW_BASE, 3)
+	words += instruction("OP_CallCppSync", function, LW_BASE + 1, GW_BASE + 7, FLOAT_BASE + 1536)
+	words += instruction("OP_Else")
+	words += instruction("OP_AddInt", LW_BASE, 1)
+	words += instruction("OP_EndIf")
+	words += instruction("OP_SwitchExpr", GSW_BASE + index % 2000)
+	words += instruction("OP_CaseIntEqual", 1)
+	words += instruction("OP_WaitFrames", 1)
+	words += instruction("OP_CaseIntRange", 2, 100)
+	words += instruction("OP_AddFloat", LF_BASE + 1, FLOAT_BASE - 512)
+	words += instruction("OP_CaseDefault")
+	words += instruction("OP_WaitMS", 100)
+	words += instruction("OP_EndSwitch")
+	words += instruction("OP_LoopIterate")
+	if callee is not None:
+		words += instruction("OP_CallScriptSync", callee)
+	words += instruction("OP_Return")
+	words += instruction("OP_ScriptEnd")
+	return words
+
+def generate(image_filename, symbol_filename, script_count, base_address=BASE_ADDRESS, seed=1):
+	rng = random.Random(seed)
+
+	script_size = len(make_script(0, 0)) * 4
+	offsets = []
+	offset = 0x100
+	for _ in range(script_count):
+		offsets.append(offset)
+		offset += script_size + rng.randint(1, 64) * 4
+	image = bytearray(offset + 0x100)
+
+	# Filler that looks like typical data: zeroes, floats, pointers and noise
+	for filler_offset in range(0, len(image), 4):
+		word = rng.choice([0, 0x3F800000, rng.getrandbits(32), base_address + 0x1234 + filler_offset])
+		struct.pack_into(">I", image, filler_offset, word)
+
+	for index, script_offset in enumerate(offsets):
+		callee = base_address + offsets[(index * 7 + 1) % script_count] if index % 3 == 0 else None
+		words = make_script(index, callee)
+		struct.pack_into(">{}I".format(len(words)), image, script_offset, *words)
+
+	with open(image_filename, "wb") as image_file:
+		image_file.write(image)
+	with open(symbol_filename, "w") as symbol_file:
+		for index, script_offset in enumerate(offsets):
+			symbol_file.write("{:08x}:evt_script_{}\n".format(base_address + script_offset, index))
+		for index in range(FUNCTION_COUNT):
+			symbol_file.write("{:08x}:function_{}\n".format(FUNCTION_ADDRESS + 4 * index, index))
+	return [base_address + script_offset for script_offset in offsets]
+
+def main():
+	parser = argparse.ArgumentParser(description="Write a synthetic script image and symbol file for ttydasm")
+	parser.add_argument("image", help="Output image filename")
+	parser.add_argument("symbols", help="Output symbol filename")
+	parser.add_argument("--script-count", type=int, default=60000)
+	parser.add_argument("--base-address", type=lambda value: int(value, 0), default=BASE_ADDRESS)
+	parser.add_argument("--seed", type=int, default=1)
+	args = parser.parse_args()
+
+	generate(args.image, args.symbols, args.script_count, args.base_address, args.seed)
+
+if __name__ == "__main__":
+	main()
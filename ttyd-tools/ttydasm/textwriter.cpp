@@ -0,0 +1,86 @@
+#include "textwriter.h"
+
+#include <algorithm>
+
+namespace
+{
+
+const char cIndentSpaces[] = "                                                                ";
+
+}
+
+TextWriter::TextWriter(FILE *file, size_t flushSize)
+	: mFile(file), mFlushSize(flushSize)
+{
+	if (mFile)
+	{
+		// Leave room for the line that crosses the flush size
+		mBuffer.reserve(mFlushSize + 0x1000);
+	}
+}
+
+void TextWriter::writeDecimal(int32_t value)
+{
+	char digits[16];
+	char *cursor = digits + sizeof(digits);
+	uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+	do
+	{
+		*--cursor = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+	if (value < 0)
+	{
+		*--cursor = '-';
+	}
+	write(cursor, digits + sizeof(digits) - cursor);
+}
+
+void TextWriter::writeHex(uint32_t value, int minDigits, bool upperCase)
+{
+	const char *hexDigits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	char digits[8];
+	int count = 0;
+	do
+	{
+		digits[7 - count++] = hexDigits[value & 0xF];
+		value >>= 4;
+	} while (value);
+	for (; count < minDigits && count < 8; ++count)
+	{
+		digits[7 - count] = '0';
+	}
+	write(digits + 8 - count, count);
+}
+
+void TextWriter::writeFloat(double value, int width, int precision)
+{
+	// Rare enough that matching printf's rounding exactly is worth more
+	char text[64];
+	int length = snprintf(text, sizeof(text), "%*.*f", width, precision, value);
+	if (length > 0)
+	{
+		write(text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+	}
+}
+
+void TextWriter::writeIndent(int level)
+{
+	size_t count = level > 0 ? static_cast<size_t>(level) * 2 : 0;
+	while (count)
+	{
+		size_t chunk = std::min(count, sizeof(cIndentSpaces) - 1);
+		write(cIndentSpaces, chunk);
+		count -= chunk;
+	}
+}
+
+void TextWriter::flush()
+{
+	if (mFile && !mBuffer.empty())
+	{
+		fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+		mBuffer.clear();
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Output buffer for listings. Text is appended to a buffer that is reused
+// across flushes, numbers are formatted in place, so writing a line does not
+// allocate once the buffer has grown. If a file is given the buffer is written
+// out in large chunks whenever it reaches the flush size, otherwise it keeps
+// everything for the caller to pick up with getText().
+class TextWriter
+{
+public:
+	static const size_t cDefaultFlushSize = 1 << 20;
+
+	explicit TextWriter(FILE *file = nullptr, size_t flushSize = cDefaultFlushSize);
+
+	void write(char c)
+	{
+		mBuffer.push_back(c);
+		checkFlush();
+	}
+	void write(const char *text, size_t size)
+	{
+		mBuffer.append(text, size);
+		checkFlush();
+	}
+	void write(const char *text)
+	{
+		write(text, strlen(text));
+	}
+	void write(const std::string &text)
+	{
+		write(text.data(), text.size());
+	}
+
+	// Like printf's %d
+	void writeDecimal(int32_t value);
+	// Like printf's %0<minDigits>X or %0<minDigits>x
+	void writeHex(uint32_t value, int minDigits = 1, bool upperCase = true);
+	// Like printf's %<width>.<precision>f
+	void writeFloat(double value, int width, int precision);
+	// Two spaces per level
+	void writeIndent(int level);
+
+	// Writes out the buffer if there is a file
+	void flush();
+
+	const std::string &getText() const
+	{
+		return mBuffer;
+	}
+	// Empties the buffer but keeps its memory
+	void clear()
+	{
+		mBuffer.clear();
+	}
+
+private:
+	void checkFlush()
+	{
+		if (mFile && mBuffer.size() >= mFlushSize)
+		{
+			flush();
+		}
+	}
+
+private:
+	FILE *mFile;
+	size_t mFlushSize;
+	std::string mBuffer;
+};
@@ -3,32 +3,45 @@
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
 #include <iostream>
 #include <fstream>
 #include <queue>
+#include <thread>
+#include <unordered_map>
 
+#include "image.h"
 #include "platform.h"
+#include "scanner.h"
+#include "scriptgraph.h"
+#include "textwriter.h"
 
 boost::program_options::variables_map gVarMap;
 
 std::vector<std::string> argStartOffsetStrings;
 std::vector<std::string> argStartAddressStrings;
 std::vector<std::string> argStartSymbolStrings;
-std::string argInputFileName;
+std::vector<std::string> argInputFileNames;
 std::string argImageBaseString;
 std::vector<std::string> argSymbolFileNames;
 bool argCrossRefScripts;
-
-unsigned char *gFileData;
-uint32_t gFileSize;
-uint32_t gCurrentAddress = 0;
-uint32_t gBaseAddress;
-
-std::vector<uint32_t> gDisassemblyList;
-
-const char *cIndentLevel = "  ";
-
-std::map<uint32_t, std::string> gSymbolMap;
+bool argScan;
+uint32_t argScanMinLength;
+int argThreadCount;
+bool argSortByAddress;
+std::string argCallGraphDotFileName;
+std::string argCallGraphJsonFileName;
+
+// Everything the disassembler reads. It is never modified while disassembling,
+// so any number of scripts can be disassembled concurrently.
+struct DisassemblyContext
+{
+	const Image *image;
+	const SymbolMap *symbolMap;
+};
 
 namespace ExpressionZones
 {
@@ -52,51 +65,21 @@ const int cGWBase = -50000000;
 const int cLWBase = -30000000;
 }
 
-template<typename... fmt_args>
-std::string formatString(char *format, fmt_args... args)
-{
-	static char sFormatBuf[512];
-	snprintf(sFormatBuf, sizeof(sFormatBuf), format, args...);
-	return std::string(sFormatBuf);
-}
-
-inline bool isAddrLoaded(uint32_t addr)
-{
-	return addr >= gBaseAddress && addr < gBaseAddress + gFileSize;
-}
-
-void *loadFile(const std::string &filename, uint32_t *filesize = nullptr, const char *mode = "rb")
+std::string lookupSymbol(const SymbolMap &symbolMap, uint32_t addr)
 {
-	FILE *file = fopen(filename.c_str(), mode);
-	fseek(file, 0, SEEK_END);
-	size_t size = ftell(file);
-	void *mem = new unsigned char[size];
-	fseek(file, 0, SEEK_SET);
-	fread(mem, 1, size, file);
-	fclose(file);
-
-	if (filesize)
-		*filesize = size;
-
-	return mem;
-}
-
-std::string lookupSymbol(uint32_t addr)
-{
-	auto it = gSymbolMap.find(addr);
+	auto it = symbolMap.find(addr);
 
-	if (it == gSymbolMap.end())
+	if (it == symbolMap.end())
 		return "";
 
 	return it->second;
 }
 
-void loadSymbolMap(const std::string &filename)
+bool loadSymbolMap(const std::string &filename, SymbolMap &symbolMap)
 {
-	uint32_t filesize;
-	char *data = static_cast<char *>(loadFile(filename, &filesize, "r"));
-	std::string data_string(data, filesize);
-	std::stringstream data_stream(data_string);
+	std::ifstream data_stream(filename);
+	if (!data_stream)
+		return false;
 
 	std::string line = "";
 	while (std::getline(data_stream, line))
@@ -108,136 +91,27 @@ void loadSymbolMap(const std::string &filename)
 
 		uint32_t addr = strtoul(line.substr(0, index).c_str(), nullptr, 16);
 
-		gSymbolMap[addr] = name;
+		symbolMap[addr] = name;
 	}
 
-	delete data;
+	return true;
 }
 
-enum ScriptOpcode
+// Hex with or without 0x, and nothing after it
+bool parseAddress(const std::string &text, uint32_t &address)
 {
-	OP_InternalFetch,
-	OP_ScriptEnd,
-	OP_Return,
-	OP_Label,
-	OP_Goto,
-	OP_LoopBegin,
-	OP_LoopIterate,
-	OP_LoopBreak,
-	OP_LoopContinue,
-	OP_WaitFrames,
-	OP_WaitMS,
-	OP_WaitUntil,
-	OP_IfStringEqual,
-	OP_IfStringNotEqual,
-	OP_IfStringLess,
-	OP_IfStringGreater,
-	OP_IfStringLessEqual,
-	OP_IfStringGreaterEqual,
-	OP_IfFloatEqual,
-	OP_IfFloatNotEqual,
-	OP_IfFloatLess,
-	OP_IfFloatGreater,
-	OP_IfFloatLessEqual,
-	OP_IfFloatGreaterEqual,
-	OP_IfIntEqual,
-	OP_IfIntNotEqual,
-	OP_IfIntLess,
-	OP_IfIntGreater,
-	OP_IfIntLessEqual,
-	OP_IfIntGreaterEqual,
-	OP_IfBitsSet,
-	OP_IfBitsClear,
-	OP_Else,
-	OP_EndIf,
-	OP_SwitchExpr,
-	OP_SwitchRaw,
-	OP_CaseIntEqual,
-	OP_CaseIntNotEqual,
-	OP_CaseIntLess,
-	OP_CaseIntGreater,
-	OP_CaseIntLessEqual,
-	OP_CaseIntGreaterEqual,
-	OP_CaseDefault,
-	OP_CaseIntEqualAny,
-	OP_CaseIntNotEqualAll,
-	OP_CaseBitsSet,
-	OP_EndMultiCase,
-	OP_CaseIntRange,
-	OP_SwitchBreak,
-	OP_EndSwitch,
-	OP_SetExprIntToExprInt,
-	OP_SetExprIntToRaw,
-	OP_SetExprFloatToExprFloat,
-	OP_AddInt,
-	OP_SubtractInt,
-	OP_MultiplyInt,
-	OP_DivideInt,
-	OP_ModuloInt,
-	OP_AddFloat,
-	OP_SubtractFloat,
-	OP_MultiplyFloat,
-	OP_DivideFloat,
-	OP_MemOpSetBaseInt,
-	OP_MemOpReadInt,
-	OP_MemOpReadInt2,
-	OP_MemOpReadInt3,
-	OP_MemOpReadInt4,
-	OP_MemOpReadIntIndexed,
-	OP_MemOpSetBaseFloat,
-	OP_MemOpReadFloat,
-	OP_MemOpReadFloat2,
-	OP_MemOpReadFloat3,
-	OP_MemOpReadFloat4,
-	OP_MemOpReadFloatIndexed,
-#ifdef GAME_SPM
-	OP_ClampInt,
-#endif
-	OP_SetUserWordBase,
-	OP_SetUserFlagBase,
-	OP_AllocateUserWordBase,
-	OP_AndExpr,
-	OP_AndRaw,
-	OP_OrExpr,
-	OP_OrRaw,
-	OP_ConvertMSToFrames,
-	OP_ConvertFramesToMS,
-	OP_StoreIntToPtr,
-	OP_StoreFloatToPtr,
-	OP_LoadIntFromPtr,
-	OP_LoadFloatFromPtr,
-	OP_StoreIntToPtrExpr,
-	OP_StoreFloatToPtrExpr,
-	OP_LoadIntFromPtrExpr,
-	OP_LoadFloatFromPtrExpr,
-	OP_CallCppSync,
-	OP_CallScriptAsync,
-	OP_CallScriptAsyncSaveTID,
-	OP_CallScriptSync,
-	OP_TerminateThread,
-	OP_Jump,
-	OP_SetThreadPriority,
-	OP_SetThreadTimeQuantum,
-	OP_SetThreadTypeMask,
-	OP_ThreadSuspendTypes,
-	OP_ThreadResumeTypes,
-	OP_ThreadSuspendTypesOther,
-	OP_ThreadResumeTypesOther,
-	OP_ThreadSuspendTID,
-	OP_ThreadResumeTID,
-	OP_CheckThreadRunning,
-	OP_ThreadStart,
-	OP_ThreadStartSaveTID,
-	OP_ThreadEnd,
-	OP_ThreadChildStart,
-	OP_ThreadChildStartSaveTID,
-	OP_ThreadChildEnd,
-	OP_DebugOutputString,
-	OP_DebugUnk1,
-	OP_DebugExprToString,
-	OP_DebugUnk2,
-	OP_DebugUnk3
-};
+	if (text.empty() || !isxdigit(static_cast<unsigned char>(text[0])))
+		return false;
+
+	char *end;
+	errno = 0;
+	unsigned long value = strtoul(text.c_str(), &end, 16);
+	if (*end != '\0' || errno == ERANGE || value > 0xFFFFFFFFul)
+		return false;
+
+	address = static_cast<uint32_t>(value);
+	return true;
+}
 
 enum class ExpressionType
 {
@@ -325,80 +199,111 @@ enum class NumericalFormat
 	Hex,
 };
 
-std::string exprToString(uint32_t expr, NumericalFormat fmt = NumericalFormat::Decimal)
+void writeExpr(TextWriter &out, const DisassemblyContext &context, uint32_t expr, NumericalFormat fmt = NumericalFormat::Decimal)
 {
 	using namespace ExpressionZones;
 
 	ExpressionType type = categorizeExpr(expr);
 
+	auto writeZone = [&](const char *name, size_t nameLength, int32_t index)
+	{
+		out.write(name, nameLength);
+		out.write('(');
+		out.writeDecimal(index);
+		out.write(')');
+	};
+#define WRITE_ZONE(name) \
+	writeZone(#name, sizeof(#name) - 1, val - c##name##Base)
+
 	const int32_t &val = *reinterpret_cast<int32_t *>(&expr);
 	if (type == ExpressionType::Address)
 	{
-		std::string symbolName = lookupSymbol(expr);
-		return symbolName != "" ? formatString("[%s]", symbolName.c_str()) : formatString("[%08X]", val);
+		auto it = context.symbolMap->find(expr);
+		out.write('[');
+		if (it != context.symbolMap->end() && !it->second.empty())
+		{
+			out.write(it->second);
+		}
+		else
+		{
+			out.writeHex(expr, 8);
+		}
+		out.write(']');
 	}
 	else if (type == ExpressionType::Float)
 	{
-		return formatString("%4.2f", (val - cFloatBase) / 1024.f);
+		out.writeFloat((val - cFloatBase) / 1024.f, 4, 2);
 	}
 	else if (type == ExpressionType::UF)
 	{
-		return formatString("UF(%d)", (val - cUFBase));
+		WRITE_ZONE(UF);
 	}
 	else if (type == ExpressionType::UW)
 	{
-		return formatString("UW(%d)", (val - cUWBase));
+		WRITE_ZONE(UW);
 	}
 	else if (type == ExpressionType::GSW)
 	{
-		return formatString("GSW(%d)", (val - cGSWBase));
+		WRITE_ZONE(GSW);
 	}
 	else if (type == ExpressionType::LSW)
 	{
-		return formatString("LSW(%d)", (val - cLSWBase));
+		WRITE_ZONE(LSW);
 	}
 	else if (type == ExpressionType::GSWF)
 	{
-		return formatString("GSWF(%d)", (val - cGSWFBase));
+		WRITE_ZONE(GSWF);
 	}
 	else if (type == ExpressionType::LSWF)
 	{
-		return formatString("LSWF(%d)", (val - cLSWFBase));
+		WRITE_ZONE(LSWF);
 	}
 	else if (type == ExpressionType::GF)
 	{
-		return formatString("GF(%d)", (val - cGFBase));
+		WRITE_ZONE(GF);
 	}
 	else if (type == ExpressionType::LF)
 	{
-		return formatString("LF(%d)", (val - cLFBase));
+		WRITE_ZONE(LF);
 	}
 	else if (type == ExpressionType::GW)
 	{
-		return formatString("GW(%d)", (val - cGWBase));
+		WRITE_ZONE(GW);
 	}
 	else if (type == ExpressionType::LW)
 	{
-		return formatString("LW(%d)", (val - cLWBase));
+		WRITE_ZONE(LW);
 	}
 	else /* if (type == ExpressionType::Immediate */
 	{
 		if (fmt == NumericalFormat::Hex)
 		{
-			return formatString("0x%X", val);
+			out.write("0x", 2);
+			out.writeHex(expr);
 		}
 		else
 		{
-			return formatString("%d", val);
+			out.writeDecimal(val);
 		}
 	}
+#undef WRITE_ZONE
 }
 
-std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done = nullptr)
+// Writes one instruction without the address or line break. Calls of scripts
+// and C functions with a constant target are appended to calls.
+void disassembleOpcode(const DisassemblyContext &context,
+					   TextWriter &out,
+					   uint32_t &address,
+					   int &indent,
+					   std::vector<ScriptCall> &calls,
+					   bool *done = nullptr)
 {
 	auto readLong = [&](uint32_t address)
 	{
-		return _byteswap_ulong(*reinterpret_cast<uint32_t *>(gFileData + address - gBaseAddress));
+		// Out of bounds reads are caught below before anything is printed
+		uint32_t value = 0;
+		context.image->readU32(address, value);
+		return value;
 	};
 	auto readParm = [&](uint32_t argIndex)
 	{
@@ -406,34 +311,70 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	};
 	auto addIndent = [&]()
 	{
-		indent += cIndentLevel;
+		++indent;
 	};
 	auto removeIndent = [&]()
 	{
-		indent = indent.substr(0, indent.size() - strlen(cIndentLevel));
+		indent = std::max(indent - 1, 0);
+	};
+	auto writeMnemonic = [&](const char *name, size_t nameLength)
+	{
+		out.writeIndent(indent);
+		out.write(name, nameLength);
 	};
 
-	uint32_t header = readLong(address);
-	address += sizeof(uint32_t);
+	auto stopAtEnd = [&]()
+	{
+		if (done)
+		{
+			*done = true;
+		}
+		out.writeIndent(indent);
+		out.write("; ", 2);
+	};
+
+	uint32_t header;
+	if (!context.image->readU32(address, header))
+	{
+		stopAtEnd();
+		out.write("address is not within the loaded image");
+		return;
+	}
 
 	uint16_t opcode = header & 0xFFFF;
 	uint16_t param_count = (header >> 16 & 0xFFFF);
 
+	if (param_count && !context.image->contains(address + sizeof(uint32_t), static_cast<uint32_t>(param_count * sizeof(uint32_t))))
+	{
+		stopAtEnd();
+		out.write("parameters of opcode ");
+		out.writeHex(opcode, 2);
+		out.write(" (");
+		out.writeDecimal(param_count);
+		out.write(") run past the end of the loaded image");
+		return;
+	}
+	address += sizeof(uint32_t);
+
+#define WRITE_MNEMONIC(name) \
+	writeMnemonic(name, sizeof(name) - 1)
+
 #define PRINT_ARGS \
 	for (uint32_t i = 0; i < param_count; ++i) \
 	{ \
-		out += " " + exprToString(readParm(i)); \
+		out.write(' '); \
+		writeExpr(out, context, readParm(i)); \
 	}
 
 #define PASSTHROUGH(value, name) \
 	case value: \
-		out = indent + name; \
+		WRITE_MNEMONIC(name); \
 		PRINT_ARGS; \
 		break;
 
 #define INDENT_IN(value, name) \
 	case value: \
-		out = indent + name; \
+		WRITE_MNEMONIC(name); \
 		PRINT_ARGS; \
 		addIndent(); \
 		break;
@@ -441,24 +382,23 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 #define INDENT_OUT(value, name) \
 	case value: \
 		removeIndent(); \
-		out = indent + name; \
+		WRITE_MNEMONIC(name); \
 		PRINT_ARGS; \
 		break;
 	
 #define INDENT_OUTIN(value, name) \
 	case value: \
 		removeIndent(); \
-		out = indent + name; \
+		WRITE_MNEMONIC(name); \
 		addIndent(); \
 		PRINT_ARGS; \
 		break;
 
 	// Mnemonic handling
-	std::string out;
 	switch (opcode)
 	{
 	case OP_ScriptEnd:
-		out = indent + "end";
+		WRITE_MNEMONIC("end");
 		if (done)
 		{
 			*done = true;
@@ -466,7 +406,8 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 		break;
 	PASSTHROUGH(OP_Return,				"return");
 	case OP_Label:
-		out = formatString("%d:", readParm(0));
+		out.writeDecimal(static_cast<int32_t>(readParm(0)));
+		out.write(':');
 		break;
 	PASSTHROUGH(OP_Goto,				"goto");
 	INDENT_IN(OP_LoopBegin,				"loop");
@@ -499,13 +440,13 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	INDENT_OUTIN(OP_Else,				"else");
 	INDENT_OUT(OP_EndIf,				"endif");
 	case OP_SwitchExpr:
-		out = indent + "switchi";
+		WRITE_MNEMONIC("switchi");
 		PRINT_ARGS;
 		addIndent();
 		addIndent();
 		break;
 	case OP_SwitchRaw:
-		out = indent + "switchr";
+		WRITE_MNEMONIC("switchr");
 		PRINT_ARGS;
 		addIndent();
 		addIndent();
@@ -526,12 +467,15 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	case OP_EndSwitch:
 		removeIndent();
 		removeIndent();
-		out = indent + "end_switch";
+		WRITE_MNEMONIC("end_switch");
 		PRINT_ARGS;
 		break;
 	PASSTHROUGH(OP_SetExprIntToExprInt, "setii");
 	case OP_SetExprIntToRaw:
-		out = indent + formatString("setir %s 0x%x", exprToString(readParm(0)).c_str(), readParm(1));
+		WRITE_MNEMONIC("setir ");
+		writeExpr(out, context, readParm(0));
+		out.write(" 0x", 3);
+		out.writeHex(readParm(1), 1, false);
 		break;
 	PASSTHROUGH(OP_SetExprFloatToExprFloat,"setff");
 	PASSTHROUGH(OP_AddInt,				"addi");
@@ -562,16 +506,28 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	PASSTHROUGH(OP_SetUserFlagBase,		"set_uf_base");
 	PASSTHROUGH(OP_AllocateUserWordBase,"alloc_uw");
 	case OP_AndExpr:
-		out = indent + formatString("andi %s %s", exprToString(readParm(0)).c_str(), exprToString(readParm(1), NumericalFormat::Hex).c_str());
+		WRITE_MNEMONIC("andi ");
+		writeExpr(out, context, readParm(0));
+		out.write(' ');
+		writeExpr(out, context, readParm(1), NumericalFormat::Hex);
 		break;
 	case OP_AndRaw:
-		out = indent + formatString("andr %s 0x%X", exprToString(readParm(0)).c_str(), readParm(1));
+		WRITE_MNEMONIC("andr ");
+		writeExpr(out, context, readParm(0));
+		out.write(" 0x", 3);
+		out.writeHex(readParm(1));
 		break;
 	case OP_OrExpr:
-		out = indent + formatString("ori %s %s", exprToString(readParm(0)).c_str(), exprToString(readParm(1), NumericalFormat::Hex).c_str());
+		WRITE_MNEMONIC("ori ");
+		writeExpr(out, context, readParm(0));
+		out.write(' ');
+		writeExpr(out, context, readParm(1), NumericalFormat::Hex);
 		break;
 	case OP_OrRaw:
-		out = indent + formatString("orr %s 0x%X", exprToString(readParm(0)).c_str(), readParm(1));
+		WRITE_MNEMONIC("orr ");
+		writeExpr(out, context, readParm(0));
+		out.write(" 0x", 3);
+		out.writeHex(readParm(1));
 		break;
 	PASSTHROUGH(OP_ConvertMSToFrames,	"cvt_ms_f");
 	PASSTHROUGH(OP_ConvertFramesToMS,	"cvt_f_ms");
@@ -611,7 +567,9 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	// OP_DebugUnk2
 	// OP_DebugUnk3
 	default:
-		out = indent + formatString("UNK[%02X]", opcode);
+		WRITE_MNEMONIC("UNK[");
+		out.writeHex(opcode, 2);
+		out.write(']');
 		PRINT_ARGS;
 		break;
 	}
@@ -619,24 +577,19 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	// Special behavior handling
 	switch (opcode)
 	{
+	case OP_CallCppSync:
 	case OP_CallScriptAsync:
 	case OP_CallScriptAsyncSaveTID:
 	case OP_CallScriptSync:
 		{
-			if (!argCrossRefScripts)
+			if (!param_count)
 				break;
 
 			uint32_t addr = readLong(address);
 			if (categorizeExpr(addr) != ExpressionType::Address)
 				break;
 
-			if (!isAddrLoaded(addr))
-				break;
-
-			if (std::find(gDisassemblyList.begin(), gDisassemblyList.end(), addr) == gDisassemblyList.end())
-			{
-				gDisassemblyList.push_back(addr);
-			}
+			calls.push_back({ addr, opcode });
 		}
 		break;
 	default:
@@ -644,20 +597,66 @@ std::string disassembleOpcode(uint32_t &address, std::string &indent, bool *done
 	}
 
 	address += param_count * sizeof(uint32_t);
-
-	return out;
 }
 
-void disassembleFunction(uint32_t address)
+void disassembleFunction(const DisassemblyContext &context,
+						 uint32_t address,
+						 TextWriter &out,
+						 std::vector<ScriptCall> &calls)
 {
 	uint32_t addr = address;
 
+	out.write("\n--- START OF DISASSEMBLY FOR FUNCTION [");
+	out.write(lookupSymbol(*context.symbolMap, address));
+	out.write("] AT ");
+	out.writeHex(address, 8);
+	out.write(" ---\n");
+
 	bool done = false;
-	std::string indentation = cIndentLevel;
+	int indentation = 1;
 	while (!done)
 	{
-		printf("%08X: ", addr);
-		printf("%s\n", disassembleOpcode(addr, indentation, &done).c_str());
+		out.writeHex(addr, 8);
+		out.write(": ", 2);
+		disassembleOpcode(context, out, addr, indentation, calls, &done);
+		out.write('\n');
+	}
+}
+
+int getDefaultThreadCount()
+{
+	return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+// Calls func(index) for every index in [0, count) on up to threadCount threads
+template<typename Func>
+void parallelFor(size_t count, int threadCount, Func func)
+{
+	size_t workerCount = std::min(static_cast<size_t>(std::max(threadCount, 1)), count);
+	if (workerCount <= 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			func(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> nextIndex(0);
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < workerCount; ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			for (size_t index = nextIndex++; index < count; index = nextIndex++)
+			{
+				func(index);
+			}
+		});
+	}
+	for (auto &worker : workers)
+	{
+		worker.join();
 	}
 }
 
@@ -680,7 +679,13 @@ int main(int argc, char **argv)
 			("base-address", po::value<std::string>(&argImageBaseString)->default_value("0x80000000"), "Base address of the input file")
 			("symbol-file", po::value<std::vector<std::string>>(&argSymbolFileNames), "Symbol file")
 			("crossref-scripts", po::value<bool>(&argCrossRefScripts)->default_value(true), "Automatically disassemble referenced scripts")
-			("input-file", po::value<std::string>(&argInputFileName), "Input file");
+			("scan", po::bool_switch(&argScan), "Search the whole input for scripts and disassemble all of them")
+			("scan-min-length", po::value<uint32_t>(&argScanMinLength)->default_value(2), "Minimum number of instructions of a script found by scanning")
+			("jobs,j", po::value<int>(&argThreadCount)->default_value(0), "Worker threads (0 = one per core)")
+			("sort-by-address", po::bool_switch(&argSortByAddress), "Output scripts in address order instead of the order they were found in")
+			("call-graph-dot", po::value<std::string>(&argCallGraphDotFileName), "Write the script call graph in Graphviz format")
+			("call-graph-json", po::value<std::string>(&argCallGraphJsonFileName), "Write the script call graph as JSON")
+			("input-file", po::value<std::vector<std::string>>(&argInputFileNames), "Input file, optionally placed at an address as <file>@<address>");
 
 		po::positional_options_description posOptions;
 		posOptions.add("input-file", -1);
@@ -688,69 +693,190 @@ int main(int argc, char **argv)
 		po::store(po::command_line_parser(argc, argv).options(desc).positional(posOptions).run(), gVarMap);
 		po::notify(gVarMap);
 
-		if (gVarMap.count("help") || gVarMap.count("input-file") != 1)
+		if (gVarMap.count("help") || !gVarMap.count("input-file"))
 		{
 			std::cout << desc << "\n";
 			return 1;
 		}
 	}
 
-	// Load input data
-	gFileData = static_cast<unsigned char *>(loadFile(argInputFileName, &gFileSize));
+	Image image;
+	SymbolMap symbolMap;
+	uint32_t imageBaseAddress = 0;
+	ScriptGraph graph;
+
+	uint32_t defaultBaseAddress;
+	if (!parseAddress(argImageBaseString, defaultBaseAddress))
+	{
+		printf("Invalid base address [%s]\n", argImageBaseString.c_str());
+		return 1;
+	}
+
+	// Load input data. Inputs without an explicit address go to the base
+	// address, offsets are relative to the first input. Anything after the
+	// last @ that isn't an address is part of the filename, e.g. dump@2x.bin.
+	for (size_t i = 0; i < argInputFileNames.size(); ++i)
+	{
+		std::string filename = argInputFileNames[i];
+		uint32_t baseAddress = defaultBaseAddress;
+		size_t separator = filename.find_last_of('@');
+		if (separator != std::string::npos && parseAddress(filename.substr(separator + 1), baseAddress))
+		{
+			filename = filename.substr(0, separator);
+		}
+
+		if (i == 0)
+		{
+			imageBaseAddress = baseAddress;
+		}
+
+		std::string error;
+		if (!image.addRegion(filename, baseAddress, &error))
+		{
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+	}
 	
 	for (size_t i = 0; i < argSymbolFileNames.size(); ++i)
 	{
-		loadSymbolMap(argSymbolFileNames[i]);
+		if (!loadSymbolMap(argSymbolFileNames[i], symbolMap))
+		{
+			printf("Failed to load symbol file [%s]\n", argSymbolFileNames[i].c_str());
+			return 1;
+		}
 	}
 
-	gBaseAddress = strtoul(argImageBaseString.c_str(), nullptr, 16);
-
 	for (auto &startAddress : argStartAddressStrings)
 	{
-		gDisassemblyList.emplace_back(strtoul(startAddress.c_str(), nullptr, 16));
+		graph.addScript(strtoul(startAddress.c_str(), nullptr, 16));
 	}
 
 	for (auto &startOffset : argStartOffsetStrings)
 	{
-		gDisassemblyList.emplace_back(strtoul(startOffset.c_str(), nullptr, 16) + gBaseAddress);
+		graph.addScript(strtoul(startOffset.c_str(), nullptr, 16) + imageBaseAddress);
 	}
 
-	for (auto &startSymbol : argStartSymbolStrings)
+	if (!argStartSymbolStrings.empty())
 	{
-		bool found = false;
+		// Lowest address wins if a name is used more than once
+		std::unordered_map<std::string, uint32_t> symbolAddresses;
+		symbolAddresses.reserve(symbolMap.size());
+		for (auto &it : symbolMap)
+		{
+			symbolAddresses.emplace(it.second, it.first);
+		}
 
-		// Pretty horrific complexity, but hey.
-		for (auto &it : gSymbolMap)
+		for (auto &startSymbol : argStartSymbolStrings)
 		{
-			if (it.second == startSymbol)
+			auto it = symbolAddresses.find(startSymbol);
+			if (it == symbolAddresses.end())
 			{
-				gDisassemblyList.emplace_back(it.first);
-				found = true;
-				break;
+				printf("Symbol [%s] not found\n", startSymbol.c_str());
+				return 1;
 			}
+			graph.addScript(it->second);
 		}
+	}
+
+	if (argScan)
+	{
+		ScanOptions scanOptions;
+		scanOptions.minInstructionCount = argScanMinLength;
 
-		if (!found)
+		std::vector<uint32_t> scripts = scanForScripts(image, scanOptions);
+		printf("Scan found %u scripts\n", static_cast<uint32_t>(scripts.size()));
+		for (uint32_t script : scripts)
 		{
-			printf("Symbol [%s] not found\n", startSymbol.c_str());
-			return 1;
+			graph.addScript(script);
 		}
 	}
 
 	// No entry address specified, so we just treat this as a flat file and start at the beginning.
-	if (!gDisassemblyList.size())
+	if (graph.getScripts().empty() && !argScan)
 	{
-		gDisassemblyList.push_back(gBaseAddress);
+		graph.addScript(imageBaseAddress);
+	}
+
+	DisassemblyContext context;
+	context.image = &image;
+	context.symbolMap = &symbolMap;
+
+	int threadCount = argThreadCount > 0 ? argThreadCount : getDefaultThreadCount();
+
+	// Scripts are disassembled in waves: every script found so far, then the
+	// scripts those reference, and so on. Calls are added to the graph in list
+	// order after each wave, so the output does not depend on the thread count.
+	// With a single thread in list order there is nothing to reorder, so
+	// scripts are written straight to the output buffer.
+	const std::vector<uint32_t> &scripts = graph.getScripts();
+	TextWriter output(stdout);
+	bool directOutput = threadCount == 1 && !argSortByAddress;
+	std::vector<TextWriter> listings;
+	size_t waveStart = 0;
+	while (waveStart < scripts.size())
+	{
+		size_t waveEnd = scripts.size();
+		std::vector<std::vector<ScriptCall>> calls(waveEnd - waveStart);
+		listings.resize(directOutput ? 0 : waveEnd);
+		parallelFor(waveEnd - waveStart, threadCount, [&](size_t index)
+		{
+			TextWriter &out = directOutput ? output : listings[waveStart + index];
+			disassembleFunction(context, scripts[waveStart + index], out, calls[index]);
+		});
+
+		for (size_t i = 0; i < calls.size(); ++i)
+		{
+			for (const auto &call : calls[i])
+			{
+				graph.addCall(scripts[waveStart + i], call);
+				if (argCrossRefScripts && call.opcode != OP_CallCppSync && image.contains(call.target))
+				{
+					graph.addScript(call.target);
+				}
+			}
+		}
+
+		if (!directOutput && !argSortByAddress)
+		{
+			// Nothing will be inserted before this wave anymore
+			for (size_t i = waveStart; i < waveEnd; ++i)
+			{
+				output.write(listings[i].getText());
+				listings[i] = TextWriter();
+			}
+		}
+		waveStart = waveEnd;
 	}
 
-	for (size_t i = 0; i < gDisassemblyList.size(); ++i)
-	{ 
-		uint32_t nextAddress = gDisassemblyList[i];
-		printf("\n--- START OF DISASSEMBLY FOR FUNCTION [%s] AT %08X ---\n", lookupSymbol(nextAddress).c_str(), nextAddress);
-		disassembleFunction(nextAddress);
+	if (argSortByAddress)
+	{
+		std::vector<size_t> order(scripts.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](size_t left, size_t right)
+		{
+			return scripts[left] < scripts[right];
+		});
+		for (size_t i : order)
+		{
+			output.write(listings[i].getText());
+		}
 	}
+	output.flush();
 
-	delete gFileData;
+	if (!argCallGraphDotFileName.empty() && !graph.saveDot(argCallGraphDotFileName, symbolMap))
+	{
+		printf("Failed to write call graph [%s]\n", argCallGraphDotFileName.c_str());
+		return 1;
+	}
+	if (!argCallGraphJsonFileName.empty() && !graph.saveJson(argCallGraphJsonFileName, symbolMap))
+	{
+		printf("Failed to write call graph [%s]\n", argCallGraphJsonFileName.c_str());
+		return 1;
+	}
 
 	resetConsoleCodePage();
 
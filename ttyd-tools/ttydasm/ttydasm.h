@@ -1 +1,134 @@
 #pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+enum ScriptOpcode
+{
+	OP_InternalFetch,
+	OP_ScriptEnd,
+	OP_Return,
+	OP_Label,
+	OP_Goto,
+	OP_LoopBegin,
+	OP_LoopIterate,
+	OP_LoopBreak,
+	OP_LoopContinue,
+	OP_WaitFrames,
+	OP_WaitMS,
+	OP_WaitUntil,
+	OP_IfStringEqual,
+	OP_IfStringNotEqual,
+	OP_IfStringLess,
+	OP_IfStringGreater,
+	OP_IfStringLessEqual,
+	OP_IfStringGreaterEqual,
+	OP_IfFloatEqual,
+	OP_IfFloatNotEqual,
+	OP_IfFloatLess,
+	OP_IfFloatGreater,
+	OP_IfFloatLessEqual,
+	OP_IfFloatGreaterEqual,
+	OP_IfIntEqual,
+	OP_IfIntNotEqual,
+	OP_IfIntLess,
+	OP_IfIntGreater,
+	OP_IfIntLessEqual,
+	OP_IfIntGreaterEqual,
+	OP_IfBitsSet,
+	OP_IfBitsClear,
+	OP_Else,
+	OP_EndIf,
+	OP_SwitchExpr,
+	OP_SwitchRaw,
+	OP_CaseIntEqual,
+	OP_CaseIntNotEqual,
+	OP_CaseIntLess,
+	OP_CaseIntGreater,
+	OP_CaseIntLessEqual,
+	OP_CaseIntGreaterEqual,
+	OP_CaseDefault,
+	OP_CaseIntEqualAny,
+	OP_CaseIntNotEqualAll,
+	OP_CaseBitsSet,
+	OP_EndMultiCase,
+	OP_CaseIntRange,
+	OP_SwitchBreak,
+	OP_EndSwitch,
+	OP_SetExprIntToExprInt,
+	OP_SetExprIntToRaw,
+	OP_SetExprFloatToExprFloat,
+	OP_AddInt,
+	OP_SubtractInt,
+	OP_MultiplyInt,
+	OP_DivideInt,
+	OP_ModuloInt,
+	OP_AddFloat,
+	OP_SubtractFloat,
+	OP_MultiplyFloat,
+	OP_DivideFloat,
+	OP_MemOpSetBaseInt,
+	OP_MemOpReadInt,
+	OP_MemOpReadInt2,
+	OP_MemOpReadInt3,
+	OP_MemOpReadInt4,
+	OP_MemOpReadIntIndexed,
+	OP_MemOpSetBaseFloat,
+	OP_MemOpReadFloat,
+	OP_MemOpReadFloat2,
+	OP_MemOpReadFloat3,
+	OP_MemOpReadFloat4,
+	OP_MemOpReadFloatIndexed,
+#ifdef GAME_SPM
+	OP_ClampInt,
+#endif
+	OP_SetUserWordBase,
+	OP_SetUserFlagBase,
+	OP_AllocateUserWordBase,
+	OP_AndExpr,
+	OP_AndRaw,
+	OP_OrExpr,
+	OP_OrRaw,
+	OP_ConvertMSToFrames,
+	OP_ConvertFramesToMS,
+	OP_StoreIntToPtr,
+	OP_StoreFloatToPtr,
+	OP_LoadIntFromPtr,
+	OP_LoadFloatFromPtr,
+	OP_StoreIntToPtrExpr,
+	OP_StoreFloatToPtrExpr,
+	OP_LoadIntFromPtrExpr,
+	OP_LoadFloatFromPtrExpr,
+	OP_CallCppSync,
+	OP_CallScriptAsync,
+	OP_CallScriptAsyncSaveTID,
+	OP_CallScriptSync,
+	OP_TerminateThread,
+	OP_Jump,
+	OP_SetThreadPriority,
+	OP_SetThreadTimeQuantum,
+	OP_SetThreadTypeMask,
+	OP_ThreadSuspendTypes,
+	OP_ThreadResumeTypes,
+	OP_ThreadSuspendTypesOther,
+	OP_ThreadResumeTypesOther,
+	OP_ThreadSuspendTID,
+	OP_ThreadResumeTID,
+	OP_CheckThreadRunning,
+	OP_ThreadStart,
+	OP_ThreadStartSaveTID,
+	OP_ThreadEnd,
+	OP_ThreadChildStart,
+	OP_ThreadChildStartSaveTID,
+	OP_ThreadChildEnd,
+	OP_DebugOutputString,
+	OP_DebugUnk1,
+	OP_DebugExprToString,
+	OP_DebugUnk2,
+	OP_DebugUnk3,
+
+	OP_Count
+};
+
+typedef std::map<uint32_t, std::string> SymbolMap;